@@ -0,0 +1,145 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * KUnit tests for the Aquacomputer Octo hwmon driver
+ *
+ * Included at the end of aquacomputer-octo.c to reach the decoder, built with
+ * make CONFIG_AQUACOMPUTER_OCTO_KUNIT_TEST=y and run when the module is
+ * loaded. Needs a kernel with CONFIG_KUNIT, 6.0 or later, where suites no
+ * longer bring their own module_init().
+ *
+ * Copyright 2021 William Mandra <wmandra@gmail.com>
+ */
+
+#include <kunit/test.h>
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 0, 0)
+#error "The KUnit tests need kernel 6.0 or later"
+#endif
+
+/* Raw register values of the fans in the sample output of the README */
+static const u16 octo_test_fan_voltage[OCTO_NUM_FANS] = {
+	1207, 1211, 1211, 1211, 1211, 1211, 1211, 1211
+};
+static const u16 octo_test_fan_current[OCTO_NUM_FANS] = { 405, 22, 22, 25, 24, 25, 25, 0 };
+static const u16 octo_test_fan_power[OCTO_NUM_FANS] = { 488, 26, 26, 30, 29, 30, 30, 0 };
+static const u16 octo_test_fan_speed[OCTO_NUM_FANS] = {
+	3028, 1167, 1161, 1155, 1154, 1137, 1129, 0
+};
+
+struct octo_test {
+	struct octo_data priv;
+	struct hid_device hdev;
+	u8 report[OCTO_STATUS_REPORT_MIN_SIZE];
+};
+
+/* The status report behind the README's sample output, Temp4 not connected */
+static void octo_test_report(u8 *report)
+{
+	int i;
+
+	report[0] = OCTO_STATUS_REPORT_ID;
+	put_unaligned_be16(2480, report + OCTO_TEMP1);
+	put_unaligned_be16(2970, report + OCTO_TEMP2);
+	put_unaligned_be16(3090, report + OCTO_TEMP3);
+	put_unaligned_be16(OCTO_TEMP_DISCONNECTED, report + OCTO_TEMP4);
+	put_unaligned_be16(1211, report + OCTO_VOLTAGE);
+	put_unaligned_be16(0, report + OCTO_FLOW_SPEED);
+
+	for (i = 0; i < OCTO_NUM_FANS; i++) {
+		put_unaligned_be16(octo_test_fan_voltage[i], report + OCTO_FAN(i, OCTO_FAN_VOLTAGE));
+		put_unaligned_be16(octo_test_fan_current[i], report + OCTO_FAN(i, OCTO_FAN_CURRENT));
+		put_unaligned_be16(octo_test_fan_power[i], report + OCTO_FAN(i, OCTO_FAN_POWER));
+		put_unaligned_be16(octo_test_fan_speed[i], report + OCTO_FAN(i, OCTO_FAN_SPEED));
+	}
+}
+
+static s32 octo_test_value(struct octo_test *ctx, enum hwmon_sensor_types type, int channel)
+{
+	return ctx->priv.sample.sensors[octo_sensor_index(ctx->priv.product, type, channel)];
+}
+
+static int octo_test_init(struct kunit *test)
+{
+	struct octo_test *ctx;
+
+	ctx = kunit_kzalloc(test, sizeof(*ctx), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, ctx);
+
+	/* Only named, for the trace events */
+	ctx->hdev.dev.kobj.name = "octo-kunit";
+	octo_scratch_init(&ctx->priv, &ctx->hdev, &octo_products[OCTO_PRODUCT_OCTO]);
+	octo_test_report(ctx->report);
+
+	test->priv = ctx;
+
+	return 0;
+}
+
+static void octo_test_readme_values(struct kunit *test)
+{
+	struct octo_test *ctx = test->priv;
+	const struct octo_product *product = ctx->priv.product;
+
+	octo_process_report(&ctx->priv, ctx->report, sizeof(ctx->report), 0);
+
+	KUNIT_EXPECT_EQ(test, octo_test_value(ctx, hwmon_temp, 0), 24800);
+	KUNIT_EXPECT_EQ(test, octo_test_value(ctx, hwmon_temp, 1), 29700);
+	KUNIT_EXPECT_EQ(test, octo_test_value(ctx, hwmon_temp, 2), 30900);
+	KUNIT_EXPECT_EQ(test, octo_test_value(ctx, hwmon_in, 0), 12110);
+	KUNIT_EXPECT_EQ(test, octo_test_value(ctx, hwmon_fan, 1), 3028);
+	KUNIT_EXPECT_EQ(test, octo_test_value(ctx, hwmon_power, 0), 4880000);
+
+	KUNIT_EXPECT_EQ(test, octo_test_value(ctx, hwmon_curr, 4), 24);
+	KUNIT_EXPECT_EQ(test, octo_test_value(ctx, hwmon_curr, 5), 25);
+	KUNIT_EXPECT_EQ(test, octo_test_value(ctx, hwmon_curr, 6), 25);
+	KUNIT_EXPECT_EQ(test, octo_test_value(ctx, hwmon_curr, 7), 0);
+
+	/* Temp4 shows as N/A, the others are connected */
+	KUNIT_EXPECT_FALSE(test, test_bit(product->bases[OCTO_GROUP_TEMP] + 2,
+					  ctx->priv.sample.disconnected));
+	KUNIT_EXPECT_TRUE(test, test_bit(product->bases[OCTO_GROUP_TEMP] + 3,
+					 ctx->priv.sample.disconnected));
+
+	/* 4.88 W + 0.26 W + 0.26 W + 0.30 W + 0.29 W + 0.30 W + 0.30 W + 0 W */
+	KUNIT_EXPECT_EQ(test, ctx->priv.sample.sensors[product->total_power], 6590000);
+}
+
+static void octo_test_unchanged(struct kunit *test)
+{
+	struct octo_test *ctx = test->priv;
+	u32 seq = ctx->priv.sample.seq;
+
+	octo_process_report(&ctx->priv, ctx->report, sizeof(ctx->report), 0);
+	octo_process_report(&ctx->priv, ctx->report, sizeof(ctx->report), NSEC_PER_SEC);
+
+	KUNIT_EXPECT_EQ(test, ctx->priv.stats.reports, 2ULL);
+	KUNIT_EXPECT_EQ(test, ctx->priv.stats.reports_unchanged, 1ULL);
+	KUNIT_EXPECT_EQ(test, ctx->priv.sample.seq, seq + 2);
+	KUNIT_EXPECT_EQ(test, octo_test_value(ctx, hwmon_curr, 0), 405);
+}
+
+static void octo_test_short(struct kunit *test)
+{
+	struct octo_test *ctx = test->priv;
+	u32 seq = ctx->priv.sample.seq;
+
+	octo_process_report(&ctx->priv, ctx->report, sizeof(ctx->report) - 1, 0);
+
+	KUNIT_EXPECT_EQ(test, ctx->priv.stats.reports_short, 1ULL);
+	KUNIT_EXPECT_EQ(test, ctx->priv.stats.reports, 0ULL);
+	KUNIT_EXPECT_EQ(test, ctx->priv.sample.seq, seq);
+}
+
+static struct kunit_case octo_test_cases[] = {
+	KUNIT_CASE(octo_test_readme_values),
+	KUNIT_CASE(octo_test_unchanged),
+	KUNIT_CASE(octo_test_short),
+	{}
+};
+
+static struct kunit_suite octo_test_suite = {
+	.name = "aquacomputer-octo",
+	.init = octo_test_init,
+	.test_cases = octo_test_cases,
+};
+kunit_test_suite(octo_test_suite);
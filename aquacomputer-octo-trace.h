@@ -0,0 +1,84 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Tracepoints for the Aquacomputer Octo hwmon driver
+ *
+ * Copyright 2021 William Mandra <wmandra@gmail.com>
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM aquacomputer_octo
+
+#if !defined(_AQUACOMPUTER_OCTO_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _AQUACOMPUTER_OCTO_TRACE_H
+
+#include <linux/hid.h>
+#include <linux/tracepoint.h>
+#include <linux/version.h>
+
+/* Since 6.10 the source of a __string() field is only given where it is declared */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 10, 0)
+#define octo_assign_device(hdev)	__assign_str(device)
+#else
+#define octo_assign_device(hdev)	__assign_str(device, dev_name(&(hdev)->dev))
+#endif
+
+/* Every report received from the device, before it is looked at */
+TRACE_EVENT(octo_report,
+	TP_PROTO(struct hid_device *hdev, u8 report_id, int size, u64 delta_ns),
+	TP_ARGS(hdev, report_id, size, delta_ns),
+
+	TP_STRUCT__entry(
+		__string(device, dev_name(&hdev->dev))
+		__field(u8, report_id)
+		__field(int, size)
+		__field(u64, delta_ns)
+	),
+
+	TP_fast_assign(
+		octo_assign_device(hdev);
+		__entry->report_id = report_id;
+		__entry->size = size;
+		__entry->delta_ns = delta_ns;
+	),
+
+	TP_printk("%s id=%u size=%d delta_ns=%llu", __get_str(device), __entry->report_id,
+		  __entry->size, __entry->delta_ns)
+);
+
+/* A status report published as sample seq, with all values in sensors[] order */
+TRACE_EVENT(octo_sample,
+	TP_PROTO(struct hid_device *hdev, u32 seq, bool changed, const s32 *sensors,
+		 unsigned int num_sensors, u64 decode_ns),
+	TP_ARGS(hdev, seq, changed, sensors, num_sensors, decode_ns),
+
+	TP_STRUCT__entry(
+		__string(device, dev_name(&hdev->dev))
+		__field(u32, seq)
+		__field(bool, changed)
+		__field(u64, decode_ns)
+		__field(unsigned int, num_sensors)
+		__dynamic_array(s32, sensors, num_sensors)
+	),
+
+	TP_fast_assign(
+		octo_assign_device(hdev);
+		__entry->seq = seq;
+		__entry->changed = changed;
+		__entry->decode_ns = decode_ns;
+		__entry->num_sensors = num_sensors;
+		memcpy(__get_dynamic_array(sensors), sensors, num_sensors * sizeof(s32));
+	),
+
+	TP_printk("%s seq=%u changed=%d decode_ns=%llu sensors=%s", __get_str(device),
+		  __entry->seq, __entry->changed, __entry->decode_ns,
+		  __print_array(__get_dynamic_array(sensors), __entry->num_sensors,
+				sizeof(s32)))
+);
+
+#endif
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE aquacomputer-octo-trace
+#include <trace/define_trace.h>
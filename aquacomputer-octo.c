@@ -1,426 +1,3003 @@
 // SPDX-License-Identifier: GPL-2.0+
 /*
- * hwmon driver for Aquacomputer Octo fan controller
+ * hwmon driver for Aquacomputer Octo fan controller, also supporting the
+ * Quadro fan controller, D5 Next pump and Farbwerk 360 RGB controller
  *
  * The Octo sends HID reports (with ID 0x01) every second to report sensor values
  * (temperatures, fan speeds, voltage, current and power). It responds to
- * Get_Report requests, but returns a dummy value of no use.
+ * Get_Report requests, but returns a dummy value of no use. The other devices
+ * follow the same scheme with their own register layout, described by a
+ * struct octo_product each.
+ *
+ * Fan settings live in a feature report (with ID 0x03) protected by a CRC-16,
+ * which is read back, modified and sent to the device, followed by a short
+ * report (with ID 0x02) committing it.
  *
  * Copyright 2021 William Mandra <wmandra@gmail.com>
  */
 
-#include <asm/unaligned.h>
-#include <linux/debugfs.h>
-#include <linux/hid.h>
-#include <linux/hwmon.h>
-#include <linux/jiffies.h>
-#include <linux/module.h>
-#include <linux/seq_file.h>
+#include <asm/unaligned.h>
+#include <linux/crc16.h>
+#include <linux/debugfs.h>
+#include <linux/hashtable.h>
+#include <linux/hid.h>
+#include <linux/hwmon.h>
+#include <linux/iio/buffer.h>
+#include <linux/iio/iio.h>
+#include <linux/iio/kfifo_buf.h>
+#include <linux/jiffies.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/overflow.h>
+#include <linux/poll.h>
+#include <linux/rcupdate.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
+#include <linux/seqlock.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/version.h>
+#include <linux/vmalloc.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
+
+#define CREATE_TRACE_POINTS
+#include "aquacomputer-octo-trace.h"
+
+#define DRIVER_NAME			"aquacomputer-octo"
+
+#define OCTO_STATUS_REPORT_ID	0x01
+
+static unsigned int update_timeout;
+module_param(update_timeout, uint, 0644);
+MODULE_PARM_DESC(update_timeout,
+		 "Time in ms after which the last report is considered stale (default: 0, twice the device's update_interval)");
+
+static bool serve_stale;
+module_param(serve_stale, bool, 0644);
+MODULE_PARM_DESC(serve_stale,
+		 "Keep returning the last received values once they are stale (default: false)");
+
+static bool hide_disconnected;
+module_param(hide_disconnected, bool, 0444);
+MODULE_PARM_DESC(hide_disconnected,
+		 "Leave out temperature sensors not connected when the hwmon device is registered (default: false)");
+
+static unsigned int history_length = 600;
+module_param(history_length, uint, 0444);
+MODULE_PARM_DESC(history_length,
+		 "Number of decoded reports kept in the debugfs history ring (default: 600, 0 to disable)");
+
+static unsigned int raw_history_length = 16;
+module_param(raw_history_length, uint, 0444);
+MODULE_PARM_DESC(raw_history_length,
+		 "Number of raw status reports kept in the debugfs reports ring (default: 16, 0 to disable)");
+
+static bool iio;
+module_param(iio, bool, 0444);
+MODULE_PARM_DESC(iio,
+		 "Register an IIO device streaming every decoded report through a buffer (default: false)");
+
+static unsigned int idle_close;
+module_param(idle_close, uint, 0444);
+MODULE_PARM_DESC(idle_close,
+		 "Time in ms without reads after which reports are stopped until the next read (default: 0, never)");
+
+static unsigned int heat_load_inlet;
+module_param(heat_load_inlet, uint, 0444);
+MODULE_PARM_DESC(heat_load_inlet,
+		 "Temperature sensor (1-4) measuring the coolant before the heat sources (default: 0, no heat load)");
+
+static unsigned int heat_load_outlet;
+module_param(heat_load_outlet, uint, 0444);
+MODULE_PARM_DESC(heat_load_outlet,
+		 "Temperature sensor (1-4) measuring the coolant after the heat sources (default: 0, no heat load)");
+
+/* All bound devices by serial number, protected by octo_devices_lock */
+static DEFINE_HASHTABLE(octo_devices, 4);
+static DEFINE_MUTEX(octo_devices_lock);
+
+/* Decodes reports outside of the HID event path */
+static struct workqueue_struct *octo_wq;
+
+/* Register offsets shared by all devices */
+
+#define OCTO_SERIAL_FIRST_PART	3
+#define OCTO_SERIAL_SECOND_PART	5
+#define OCTO_FIRMWARE_VERSION	13
+#define OCTO_POWER_CYCLES		24
+
+/* Each fan channel is reported in a 13 byte block */
+
+#define OCTO_FAN_BLOCK_SIZE		13
+
+#define OCTO_FAN_VOLTAGE		0
+#define OCTO_FAN_CURRENT		2
+#define OCTO_FAN_POWER		4
+#define OCTO_FAN_SPEED		6
+
+#define OCTO_FAN_BLOCK(start, n, reg)	((start) + (n) * OCTO_FAN_BLOCK_SIZE + (reg))
+
+/* Register offsets for the Octo */
+
+#define OCTO_TEMP1			61
+#define OCTO_TEMP2			63
+#define OCTO_TEMP3			65
+#define OCTO_TEMP4			67
+
+#define OCTO_FLOW_SPEED		123
+#define OCTO_VOLTAGE			117
+
+#define OCTO_NUM_FANS			8
+#define OCTO_FAN_BLOCK_START	127
+
+#define OCTO_FAN(n, reg)		OCTO_FAN_BLOCK(OCTO_FAN_BLOCK_START, n, reg)
+
+/* Status reports must at least cover the last decoded register */
+#define OCTO_STATUS_REPORT_MIN_SIZE	(OCTO_FAN(OCTO_NUM_FANS - 1, OCTO_FAN_SPEED) + 2)
+#define OCTO_SENSOR_REGION_START	OCTO_TEMP1
+
+/* Register offsets for the Quadro */
+
+#define QUADRO_TEMP1			52
+#define QUADRO_TEMP2			54
+#define QUADRO_TEMP3			56
+#define QUADRO_TEMP4			58
+
+#define QUADRO_FLOW_SPEED		110
+
+#define QUADRO_NUM_FANS		4
+#define QUADRO_FAN_BLOCK_START	114
+
+#define QUADRO_FAN(n, reg)		OCTO_FAN_BLOCK(QUADRO_FAN_BLOCK_START, n, reg)
+
+#define QUADRO_STATUS_REPORT_MIN_SIZE	(QUADRO_FAN(QUADRO_NUM_FANS - 1, OCTO_FAN_SPEED) + 2)
+#define QUADRO_SENSOR_REGION_START	QUADRO_TEMP1
+
+/* Register offsets for the D5 Next, with a fan block each for the pump and the fan output */
+
+#define D5NEXT_COOLANT_TEMP		87
+
+#define D5NEXT_12V_VOLTAGE		55
+#define D5NEXT_5V_VOLTAGE		57
+
+#define D5NEXT_FAN_BLOCK		97
+#define D5NEXT_PUMP_BLOCK		110
+
+#define D5NEXT_FLOW_SPEED		0 /* No flow sensor */
+
+#define D5NEXT_STATUS_REPORT_MIN_SIZE	(D5NEXT_PUMP_BLOCK + OCTO_FAN_SPEED + 2)
+#define D5NEXT_SENSOR_REGION_START	D5NEXT_12V_VOLTAGE
+
+/* Register offsets for the Farbwerk 360, which only has temperature sensors */
+
+#define FARBWERK360_TEMP1		50
+#define FARBWERK360_TEMP2		52
+#define FARBWERK360_TEMP3		54
+#define FARBWERK360_TEMP4		56
+
+#define FARBWERK360_FLOW_SPEED	0 /* No flow sensor */
+
+#define FARBWERK360_STATUS_REPORT_MIN_SIZE	(FARBWERK360_TEMP4 + 2)
+#define FARBWERK360_SENSOR_REGION_START	FARBWERK360_TEMP1
+
+/* Control report, with one fan control block per fan */
+
+#define OCTO_CTRL_REPORT_ID		0x03
+#define OCTO_CTRL_CHECKSUM_START	0x01
+#define OCTO_CTRL_CHECKSUM_LENGTH(size)	((size) - 3)
+#define OCTO_CTRL_CHECKSUM(size)	((size) - 2)
+
+#define OCTO_FAN_CTRL_MODE		0x00 /* 0 for a fixed duty cycle */
+#define OCTO_FAN_CTRL_PWM		0x01 /* Duty cycle in 0.01 % */
+
+#define OCTO_CTRL_REPORT_SIZE		0x65F
+#define QUADRO_CTRL_REPORT_SIZE	0x3C1
+#define D5NEXT_CTRL_REPORT_SIZE	0x329
+#define FARBWERK360_CTRL_REPORT_SIZE	0 /* No fans to control */
+
+/* Fan control block offsets as X(arg, offset), in pwm channel order */
+
+#define OCTO_FAN_CTRL(X, arg) \
+	X(arg, 0x5A) X(arg, 0xAF) X(arg, 0x104) X(arg, 0x159) \
+	X(arg, 0x1AE) X(arg, 0x203) X(arg, 0x258) X(arg, 0x2AD)
+
+#define QUADRO_FAN_CTRL(X, arg) \
+	X(arg, 0x36) X(arg, 0x8B) X(arg, 0xE0) X(arg, 0x135)
+
+/* Pump, then fan */
+#define D5NEXT_FAN_CTRL(X, arg) \
+	X(arg, 0x97) X(arg, 0x42)
+
+#define FARBWERK360_FAN_CTRL(X, arg)
+
+#define OCTO_SECONDARY_REPORT_ID	0x02
+
+/* Delay within which pwm writes are coalesced into one control report */
+#define OCTO_CTRL_FLUSH_DELAY	msecs_to_jiffies(100)
+
+/* Commits the control report sent before it */
+static const u8 octo_secondary_report[] = {
+	0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x34, 0xC6
+};
+
+/*
+ * Sensor descriptor lists, one per device and hwmon type. Each entry is
+ * X(arg, label, offset, multiplier): the big endian u16 at offset in the
+ * status report, times multiplier, is reported under label. Multipliers
+ * convert straight to hwmon units, so decoding never divides and keeps
+ * the full resolution of the device. Temperatures are signed, all other
+ * values unsigned. The decode tables, labels, hwmon channels and the
+ * layout of struct octo_sample->sensors are all generated from these lists.
+ *
+ * Entries with a multiplier of 0 decode to 0 and are computed from the
+ * other values by octo_derive() instead.
+ */
+
+#define OCTO_FAN_SENSORS(X, arg, what, reg, mul) \
+	X(arg, "Fan1 " what, OCTO_FAN(0, reg), mul) \
+	X(arg, "Fan2 " what, OCTO_FAN(1, reg), mul) \
+	X(arg, "Fan3 " what, OCTO_FAN(2, reg), mul) \
+	X(arg, "Fan4 " what, OCTO_FAN(3, reg), mul) \
+	X(arg, "Fan5 " what, OCTO_FAN(4, reg), mul) \
+	X(arg, "Fan6 " what, OCTO_FAN(5, reg), mul) \
+	X(arg, "Fan7 " what, OCTO_FAN(6, reg), mul) \
+	X(arg, "Fan8 " what, OCTO_FAN(7, reg), mul)
+
+/* Temperatures in 0.01 degC, reported in millidegrees */
+#define OCTO_TEMP_SENSORS(X, arg) \
+	X(arg, "Temp1", OCTO_TEMP1, 10) \
+	X(arg, "Temp2", OCTO_TEMP2, 10) \
+	X(arg, "Temp3", OCTO_TEMP3, 10) \
+	X(arg, "Temp4", OCTO_TEMP4, 10)
+
+/*
+ * Flow in 0.1 l/h, kept at that resolution and divided into l/h only for
+ * fan1_input and fan1_min, followed by fan speeds in RPM
+ */
+#define OCTO_SPEED_SENSORS(X, arg) \
+	X(arg, "Flow speed [dL/h]", OCTO_FLOW_SPEED, 1) \
+	OCTO_FAN_SENSORS(X, arg, "speed", OCTO_FAN_SPEED, 1)
+
+/* Power in 0.01 W, reported in microwatts, followed by derived values */
+#define OCTO_POWER_SENSORS(X, arg) \
+	OCTO_FAN_SENSORS(X, arg, "power", OCTO_FAN_POWER, 10000) \
+	X(arg, "Total fan power", 0, 0) \
+	X(arg, "Heat load", 0, 0)
+
+/* Voltages in 0.01 V, reported in millivolts */
+#define OCTO_VOLTAGE_SENSORS(X, arg) \
+	X(arg, "VCC", OCTO_VOLTAGE, 10) \
+	OCTO_FAN_SENSORS(X, arg, "voltage", OCTO_FAN_VOLTAGE, 10)
+
+/* Currents in milliamperes */
+#define OCTO_CURRENT_SENSORS(X, arg) \
+	OCTO_FAN_SENSORS(X, arg, "current", OCTO_FAN_CURRENT, 1)
+
+/* The Quadro reports like the Octo, with four fans */
+
+#define QUADRO_FAN_SENSORS(X, arg, what, reg, mul) \
+	X(arg, "Fan1 " what, QUADRO_FAN(0, reg), mul) \
+	X(arg, "Fan2 " what, QUADRO_FAN(1, reg), mul) \
+	X(arg, "Fan3 " what, QUADRO_FAN(2, reg), mul) \
+	X(arg, "Fan4 " what, QUADRO_FAN(3, reg), mul)
+
+#define QUADRO_TEMP_SENSORS(X, arg) \
+	X(arg, "Temp1", QUADRO_TEMP1, 10) \
+	X(arg, "Temp2", QUADRO_TEMP2, 10) \
+	X(arg, "Temp3", QUADRO_TEMP3, 10) \
+	X(arg, "Temp4", QUADRO_TEMP4, 10)
+
+#define QUADRO_SPEED_SENSORS(X, arg) \
+	X(arg, "Flow speed [dL/h]", QUADRO_FLOW_SPEED, 1) \
+	QUADRO_FAN_SENSORS(X, arg, "speed", OCTO_FAN_SPEED, 1)
+
+#define QUADRO_POWER_SENSORS(X, arg) \
+	QUADRO_FAN_SENSORS(X, arg, "power", OCTO_FAN_POWER, 10000) \
+	X(arg, "Total fan power", 0, 0) \
+	X(arg, "Heat load", 0, 0)
+
+#define QUADRO_VOLTAGE_SENSORS(X, arg) \
+	QUADRO_FAN_SENSORS(X, arg, "voltage", OCTO_FAN_VOLTAGE, 10)
+
+#define QUADRO_CURRENT_SENSORS(X, arg) \
+	QUADRO_FAN_SENSORS(X, arg, "current", OCTO_FAN_CURRENT, 1)
+
+/* The D5 Next reports its pump and one fan output, in the same units */
+
+#define D5NEXT_FAN_SENSORS(X, arg, what, reg, mul) \
+	X(arg, "Pump " what, D5NEXT_PUMP_BLOCK + (reg), mul) \
+	X(arg, "Fan " what, D5NEXT_FAN_BLOCK + (reg), mul)
+
+#define D5NEXT_TEMP_SENSORS(X, arg) \
+	X(arg, "Coolant temp", D5NEXT_COOLANT_TEMP, 10)
+
+#define D5NEXT_SPEED_SENSORS(X, arg) \
+	D5NEXT_FAN_SENSORS(X, arg, "speed", OCTO_FAN_SPEED, 1)
+
+#define D5NEXT_POWER_SENSORS(X, arg) \
+	D5NEXT_FAN_SENSORS(X, arg, "power", OCTO_FAN_POWER, 10000) \
+	X(arg, "Total power", 0, 0)
+
+#define D5NEXT_VOLTAGE_SENSORS(X, arg) \
+	X(arg, "+12V voltage", D5NEXT_12V_VOLTAGE, 10) \
+	X(arg, "+5V voltage", D5NEXT_5V_VOLTAGE, 10) \
+	D5NEXT_FAN_SENSORS(X, arg, "voltage", OCTO_FAN_VOLTAGE, 10)
+
+#define D5NEXT_CURRENT_SENSORS(X, arg) \
+	D5NEXT_FAN_SENSORS(X, arg, "current", OCTO_FAN_CURRENT, 1)
+
+/* The Farbwerk 360 only reports temperatures */
+
+#define FARBWERK360_TEMP_SENSORS(X, arg) \
+	X(arg, "Temp1", FARBWERK360_TEMP1, 10) \
+	X(arg, "Temp2", FARBWERK360_TEMP2, 10) \
+	X(arg, "Temp3", FARBWERK360_TEMP3, 10) \
+	X(arg, "Temp4", FARBWERK360_TEMP4, 10)
+
+#define FARBWERK360_SPEED_SENSORS(X, arg)
+#define FARBWERK360_POWER_SENSORS(X, arg)
+#define FARBWERK360_VOLTAGE_SENSORS(X, arg)
+#define FARBWERK360_CURRENT_SENSORS(X, arg)
+
+/*
+ * All lists of device p as G(p, hwmon type, list name, hwmon channel
+ * config), in sensors[] order
+ */
+#define OCTO_SENSOR_GROUPS(G, p) \
+	G(p, temp, TEMP, HWMON_T_INPUT | HWMON_T_LABEL | HWMON_T_LOWEST | HWMON_T_HIGHEST | \
+			 HWMON_T_RESET_HISTORY | HWMON_T_MAX | HWMON_T_MAX_ALARM | \
+			 HWMON_T_CRIT | HWMON_T_CRIT_ALARM) \
+	G(p, fan, SPEED, HWMON_F_INPUT | HWMON_F_LABEL | HWMON_F_MIN | HWMON_F_ALARM) \
+	G(p, power, POWER, HWMON_P_INPUT | HWMON_P_LABEL | HWMON_P_INPUT_LOWEST | \
+			   HWMON_P_INPUT_HIGHEST | HWMON_P_AVERAGE | HWMON_P_RESET_HISTORY) \
+	G(p, in, VOLTAGE, HWMON_I_INPUT | HWMON_I_LABEL | HWMON_I_LOWEST | HWMON_I_HIGHEST | \
+			  HWMON_I_AVERAGE | HWMON_I_RESET_HISTORY) \
+	G(p, curr, CURRENT, HWMON_C_INPUT | HWMON_C_LABEL | HWMON_C_LOWEST | HWMON_C_HIGHEST | \
+			    HWMON_C_AVERAGE | HWMON_C_RESET_HISTORY)
+
+#define OCTO_COUNT_ENTRY(arg, label, off, mul)	+ 1
+#define OCTO_COUNT(p, name)	(0 p##_##name##_SENSORS(OCTO_COUNT_ENTRY, 0))
+
+/* Index of the first value of each group in struct octo_sample->sensors */
+
+#define OCTO_BASE_TEMP(p)		0
+#define OCTO_BASE_SPEED(p)		(OCTO_BASE_TEMP(p) + OCTO_COUNT(p, TEMP))
+#define OCTO_BASE_POWER(p)		(OCTO_BASE_SPEED(p) + OCTO_COUNT(p, SPEED))
+#define OCTO_BASE_VOLTAGE(p)		(OCTO_BASE_POWER(p) + OCTO_COUNT(p, POWER))
+#define OCTO_BASE_CURRENT(p)		(OCTO_BASE_VOLTAGE(p) + OCTO_COUNT(p, VOLTAGE))
+#define OCTO_NUM_SENSORS(p)		(OCTO_BASE_CURRENT(p) + OCTO_COUNT(p, CURRENT))
+
+#define OCTO_GROUP_ENUM(p, type, name, config)	OCTO_GROUP_##name,
+
+enum octo_group {
+	OCTO_SENSOR_GROUPS(OCTO_GROUP_ENUM, OCTO)
+	OCTO_NUM_GROUPS
+};
+
+/* Derived values, 0 where a device has none */
+
+#define OCTO_SENSOR_TOTAL_POWER	(OCTO_BASE_POWER(OCTO) + OCTO_NUM_FANS)
+#define OCTO_SENSOR_HEAT_LOAD		(OCTO_SENSOR_TOTAL_POWER + 1)
+#define QUADRO_SENSOR_TOTAL_POWER	(OCTO_BASE_POWER(QUADRO) + QUADRO_NUM_FANS)
+#define QUADRO_SENSOR_HEAT_LOAD	(QUADRO_SENSOR_TOTAL_POWER + 1)
+#define D5NEXT_SENSOR_TOTAL_POWER	(OCTO_BASE_POWER(D5NEXT) + 2)
+#define D5NEXT_SENSOR_HEAT_LOAD	0
+#define FARBWERK360_SENSOR_TOTAL_POWER	0
+#define FARBWERK360_SENSOR_HEAT_LOAD	0
+
+/*
+ * Energy counters, integrated from the values of the power list up to its
+ * total rather than decoded, in the same order
+ */
+
+#define OCTO_ENERGY_SENSORS(X, arg) \
+	OCTO_FAN_SENSORS(X, arg, "energy", 0, 0) \
+	X(arg, "Total fan energy", 0, 0)
+
+#define QUADRO_ENERGY_SENSORS(X, arg) \
+	QUADRO_FAN_SENSORS(X, arg, "energy", 0, 0) \
+	X(arg, "Total fan energy", 0, 0)
+
+#define D5NEXT_ENERGY_SENSORS(X, arg) \
+	D5NEXT_FAN_SENSORS(X, arg, "energy", 0, 0) \
+	X(arg, "Total energy", 0, 0)
+
+#define FARBWERK360_ENERGY_SENSORS(X, arg)
+
+#define OCTO_MAX_ENERGY		OCTO_COUNT(OCTO, ENERGY)
+
+/* Reported by temperature sensors that are not connected */
+#define OCTO_TEMP_DISCONNECTED	0x7FFF
+
+/* Volumetric heat capacity of water in J/(l K), used for the heat load */
+#define OCTO_COOLANT_HEAT_CAPACITY	4186
+
+/* The Octo has the most values, sample buffers are sized for it */
+#define OCTO_MAX_SENSORS		OCTO_NUM_SENSORS(OCTO)
+#define OCTO_MAX_SENSOR_REGION	(OCTO_STATUS_REPORT_MIN_SIZE - OCTO_SENSOR_REGION_START)
+
+/* Describes how a single value of struct octo_sample->sensors is decoded */
+struct octo_field {
+	u8 offset;
+	bool is_signed;
+	u16 multiplier;
+};
+
+#define OCTO_SIGNED_TEMP		true
+#define OCTO_SIGNED_SPEED		false
+#define OCTO_SIGNED_POWER		false
+#define OCTO_SIGNED_VOLTAGE		false
+#define OCTO_SIGNED_CURRENT		false
+
+/* Everything that differs between the supported devices */
+struct octo_product {
+	const char *name; /* Of the hwmon device */
+	const struct hwmon_chip_info *chip_info;
+	const struct octo_field *fields;
+	const char *const *labels;
+	u16 labels_size; /* Of all labels, including their terminating NULs */
+	u16 counts[OCTO_NUM_GROUPS]; /* Number of values per group */
+	u16 bases[OCTO_NUM_GROUPS]; /* Index of the first value of each group */
+	u16 num_sensors;
+	u16 status_report_min_size;
+	u16 sensor_region_start; /* First decoded register, up to status_report_min_size */
+	u16 flow_speed; /* Offset of the flow speed, 0 without flow sensor */
+	u16 total_power; /* Index of the total power, 0 if not derived */
+	u16 heat_load; /* Index of the heat load, 0 if not derived */
+	u8 num_energy; /* Energy counters, for the first power values */
+	const char *const *energy_labels;
+	u16 ctrl_report_size;
+	u8 num_fans; /* Fan outputs that can be controlled */
+	const u16 *fan_ctrl_offsets;
+};
+
+enum octo_product_id {
+	OCTO_PRODUCT_OCTO,
+	OCTO_PRODUCT_QUADRO,
+	OCTO_PRODUCT_D5NEXT,
+	OCTO_PRODUCT_FARBWERK360,
+};
+
+/* Default and maximum number of reports averaged, set through the "samples" attribute */
+#define OCTO_AVERAGE_SAMPLES		60
+#define OCTO_AVERAGE_SAMPLES_MAX	3600
+
+/* Default and range of the expected report interval in ms, set through "update_interval" */
+#define OCTO_UPDATE_INTERVAL		1000
+#define OCTO_UPDATE_INTERVAL_MIN	100
+#define OCTO_UPDATE_INTERVAL_MAX	60000
+
+/* Limits checked against every report, each raising its own alarm */
+enum octo_alarm {
+	OCTO_ALARM_MIN, /* Fan speed or flow below fan*_min */
+	OCTO_ALARM_MAX, /* Temperature above temp*_max */
+	OCTO_ALARM_CRIT, /* Temperature above temp*_crit */
+	OCTO_NUM_ALARMS,
+};
+
+/* Sensor values decoded from a single status report */
+struct octo_sample {
+	unsigned long updated;
+	u32 seq; /* Number of reports received */
+	s32 sensors[OCTO_MAX_SENSORS]; /* Only the first num_sensors of the device are used */
+	DECLARE_BITMAP(disconnected, OCTO_MAX_SENSORS); /* Values without a sensor behind */
+	unsigned long alarms[OCTO_NUM_ALARMS][BITS_TO_LONGS(OCTO_MAX_SENSORS)]; /* Limits crossed */
+	u64 energy[OCTO_MAX_ENERGY]; /* In microjoules since probe */
+};
+
+/*
+ * Extremes since the last history reset and averages over the last
+ * completed window of avg_samples reports, indexed like the sample
+ */
+struct octo_aggregates {
+	s32 lowest[OCTO_MAX_SENSORS];
+	s32 highest[OCTO_MAX_SENSORS];
+	s32 average[OCTO_MAX_SENSORS];
+	bool average_valid; /* Set once the first window is complete */
+};
+
+/* Values kept per sensor, as served by the hwmon attributes */
+enum octo_value {
+	OCTO_VALUE_INPUT,
+	OCTO_VALUE_LOWEST,
+	OCTO_VALUE_HIGHEST,
+	OCTO_VALUE_AVERAGE,
+};
+
+/*
+ * Binary layout of the debugfs "sensors" file. Values follow the order of
+ * the "sensors_text" file, counts[] gives the number of values per group
+ * (temperatures, speeds, power, voltages, currents), only the first
+ * num_sensors values are used. The version is bumped whenever the layout
+ * changes.
+ */
+#define OCTO_SNAPSHOT_VERSION	4
+
+struct octo_snapshot {
+	u32 version;
+	u32 seq; /* Number of reports received, changes with every new sample */
+	u32 age_ms; /* Time since the sample was received */
+	u32 serial_number[2];
+	u32 power_cycles;
+	u16 firmware_version;
+	u16 product; /* USB product ID of the device */
+	u16 num_sensors;
+	u16 counts[OCTO_NUM_GROUPS];
+	s32 sensors[OCTO_MAX_SENSORS];
+} __packed;
+
+/*
+ * Ring of fixed size records that userspace can mmap read-only. The buffer
+ * starts with a page holding struct octo_ring_header, followed by the
+ * records. A record's sequence number is zero while it is being rewritten,
+ * so readers can detect records that were overwritten while copying them.
+ */
+#define OCTO_RING_VERSION	3
+
+/* 32 bit counters, so that they can be published atomically on every arch */
+struct octo_ring_header {
+	u32 version;
+	u32 record_size;
+	u32 num_records;
+	u32 head; /* Records written so far, the newest is at (head - 1) % num_records */
+};
+
+struct octo_ring_record {
+	u32 seq; /* head value after this record was written */
+	u32 len; /* Bytes used in data */
+	u64 timestamp_ns; /* CLOCK_MONOTONIC */
+	u8 data[];
+};
+
+struct octo_ring {
+	void *buf;
+	size_t size;
+	size_t record_size;
+	size_t data_size;
+	u32 num_records;
+	u32 next;
+};
+
+/*
+ * Hot path instrumentation. Each report counter is only written from either
+ * the HID event path or decode_work, the read counters from any number of
+ * hwmon readers, so they are kept apart.
+ */
+#define OCTO_HIST_BUCKETS	16
+
+struct octo_stats {
+	u64 reports;
+	u64 reports_ignored; /* Reports with another ID than the status report */
+	u64 reports_short; /* Status reports too short to be decoded */
+	u64 reports_coalesced; /* Status reports replaced by a newer one before being decoded */
+	u64 reports_unchanged; /* Status reports with the same sensor registers as the previous one */
+	u64 decode_ns_total;
+	u64 decode_ns_max;
+	u64 last_report_ns;
+	u64 last_event_ns; /* Any report, only kept while octo_report is traced */
+	u32 decode_ns_hist[OCTO_HIST_BUCKETS]; /* Bucket n counts values below 2^n ns */
+	u32 gap_ms_hist[OCTO_HIST_BUCKETS]; /* Bucket n counts gaps below 2^n ms */
+};
+
+struct octo_read_stats {
+	atomic_long_t reads;
+	atomic_long_t reads_stale;
+	unsigned long last_read; /* In jiffies, only tracked with idle_close */
+};
+
+/*
+ * Fan control state, protected by lock. The control report is cached after
+ * the first fetch and changed in place by writes, so that it only has to be
+ * read from the device again once it is invalidated.
+ */
+struct octo_ctrl {
+	struct mutex lock;
+	struct delayed_work flush_work; /* Sends pending changes in one control report */
+	u8 *buf; /* Cached control report */
+	u8 *secondary; /* Buffer for octo_secondary_report */
+	bool valid; /* buf matches the device, apart from pending changes */
+	bool dirty; /* buf holds changes not sent yet */
+	u32 requests; /* Accepted pwm and pwm_enable writes */
+	u32 fetches; /* Control reports read from the device */
+	u32 flushes; /* Control reports sent */
+	u32 errors; /* Failed control report updates */
+};
+
+/*
+ * Grouped by who touches what: the published sample, which every reader
+ * loads, starts its own cache line with the seqlock and the header fields
+ * checked on each read. State private to decoding and counters
+ * written by readers each live on separate lines, so neither side dirties
+ * lines the other is reading. Allocated with kzalloc(), which aligns
+ * objects of this size to at least a cache line.
+ */
+struct octo_data {
+	/* Set up at probe or by the first report, then read-mostly */
+	struct hid_device *hdev;
+	const struct octo_product *product;
+	struct device *hwmon_dev;
+	struct dentry *debugfs;
+	unsigned int status_report_size; /* Minimum size of an acceptable status report */
+	unsigned int status_report_len; /* As declared by the descriptor and read from hidraw */
+	u32 serial_number[2];
+	u32 power_cycles; /* How many times the device was powered on */
+	u16 firmware_version;
+	u64 probed_ns; /* Monotonic time of probe, which energy is counted from */
+	unsigned int update_interval; /* Expected time between reports in ms */
+	struct rcu_head rcu; /* epoll may still look at wait until a grace period after removal */
+
+	/* Latest status report not decoded yet, handed over to decode_work */
+	spinlock_t pending_lock ____cacheline_aligned_in_smp; /* Protects pending* */
+	u8 *pending; /* status_report_len bytes */
+	int pending_size; /* 0 while empty */
+	u64 pending_ns; /* When the report was received */
+	struct work_struct decode_work;
+	u8 *decode_buf; /* Swapped with pending, only touched by decode_work */
+
+	/* Written once per report, read by all readers */
+	seqlock_t lock ____cacheline_aligned_in_smp; /* Protects sample, aggr and avg_* */
+	struct octo_sample sample;
+	struct octo_aggregates aggr;
+
+	/* Written by decode_work, the wait queue also by pollers */
+	wait_queue_head_t wait ____cacheline_aligned_in_smp; /* Woken up for every new sample */
+	struct octo_ring history; /* Recent samples' sensor values */
+	struct octo_ring reports; /* Recent raw status reports */
+	struct octo_stats stats;
+	u8 sensor_regs[OCTO_MAX_SENSOR_REGION]; /* Sensor registers of the previous report */
+	u32 energy_rem[OCTO_MAX_ENERGY]; /* Below a microjoule, in uW * us */
+	unsigned int avg_samples; /* Reports per averaging window */
+	unsigned int avg_count; /* Reports in the current window */
+	s64 avg_sum[OCTO_MAX_SENSORS];
+
+	/* Written by readers */
+	struct octo_read_stats read_stats ____cacheline_aligned_in_smp;
+
+	/* Alarm limits indexed like the sample, written by readers and read per report */
+	s32 limits[OCTO_NUM_ALARMS][OCTO_MAX_SENSORS];
+
+	/* Only used by fan control requests */
+	struct octo_ctrl ctrl ____cacheline_aligned_in_smp;
+
+	/* Report stream, closed while idle if idle_close is set */
+	struct mutex stream_lock;
+	struct delayed_work idle_work; /* Closes the stream once no reads happened for a while */
+	bool stream_open; /* Protected by stream_lock, read locklessly by readers */
+
+	/* Deferred hwmon registration */
+	struct delayed_work hwmon_work; /* Registers hwmon_dev on the first report */
+	bool removing; /* Keeps reports from queueing hwmon_work, protected by lock */
+
+	/* Result of the last debugfs replay, protected by replay_lock */
+	struct mutex replay_lock;
+	u32 replay_loops; /* How many times each replayed buffer is decoded */
+	u64 replay_reports;
+	u64 replay_unchanged;
+	u64 replay_ns;
+	s32 replay_sensors[OCTO_MAX_SENSORS];
+
+#if IS_REACHABLE(CONFIG_IIO_KFIFO_BUF)
+	/* Optional IIO device, set at probe and only pushed to from decode_work */
+	struct iio_dev *iio;
+	struct {
+		s32 sensors[OCTO_MAX_SENSORS];
+		s64 timestamp __aligned(8);
+	} iio_scan;
+#endif
+
+	/* Driver-wide registry entry, protected by octo_devices_lock */
+	struct work_struct register_work; /* Adds the device once its serial is known */
+	struct hlist_node node;
+	struct dentry *by_serial;
+	bool registered;
+};
+
+static void octo_hist_add(u32 *hist, u64 value)
+{
+	hist[min_t(int, fls64(value), OCTO_HIST_BUCKETS - 1)]++;
+}
+
+/* Time in ms after which the last report is stale, twice the expected interval by default */
+static unsigned int octo_stale_timeout(const struct octo_data *priv)
+{
+	unsigned int timeout = READ_ONCE(update_timeout);
+
+	return timeout ? timeout : 2 * READ_ONCE(priv->update_interval);
+}
+
+/* Copies the latest sample without ever blocking the HID event path */
+static void octo_get_sample(struct octo_data *priv, struct octo_sample *sample)
+{
+	unsigned int seq;
+
+	do {
+		seq = read_seqbegin(&priv->lock);
+		*sample = priv->sample;
+	} while (read_seqretry(&priv->lock, seq));
+}
+
+static const s32 *octo_values(struct octo_data *priv, enum octo_value kind)
+{
+	switch (kind) {
+	case OCTO_VALUE_LOWEST:
+		return priv->aggr.lowest;
+	case OCTO_VALUE_HIGHEST:
+		return priv->aggr.highest;
+	case OCTO_VALUE_AVERAGE:
+		return priv->aggr.average;
+	default:
+		return priv->sample.sensors;
+	}
+}
+
+static int octo_read_value(struct octo_data *priv, enum octo_value kind, int index, long *val)
+{
+	const s32 *values = octo_values(priv, kind);
+	bool average_valid, disconnected;
+	unsigned long updated;
+	unsigned int seq;
+	u32 reports;
+
+	do {
+		seq = read_seqbegin(&priv->lock);
+		updated = priv->sample.updated;
+		reports = priv->sample.seq;
+		average_valid = priv->aggr.average_valid;
+		disconnected = test_bit(index, priv->sample.disconnected);
+		*val = values[index];
+	} while (read_seqretry(&priv->lock, seq));
+
+	if (!reports || disconnected)
+		goto stale;
+
+	/* Only current values go stale, extremes and averages describe the past */
+	if (kind == OCTO_VALUE_INPUT && !READ_ONCE(serve_stale) &&
+	    time_after(jiffies, updated + msecs_to_jiffies(octo_stale_timeout(priv))))
+		goto stale;
+
+	if (kind == OCTO_VALUE_AVERAGE && !average_valid)
+		goto stale;
+
+	atomic_long_inc(&priv->read_stats.reads);
+
+	return 0;
+
+stale:
+	atomic_long_inc(&priv->read_stats.reads_stale);
+
+	return -ENODATA;
+}
+
+/*
+ * Called with priv->lock held for writing, once the report's values are
+ * stored. Extremes of the values in restart start over from the current
+ * value, which keeps disconnected sensors out of them.
+ */
+static void octo_aggregate(struct octo_data *priv, bool changed, const unsigned long *restart)
+{
+	struct octo_aggregates *aggr = &priv->aggr;
+	const s32 *values = priv->sample.sensors;
+	int i, num = priv->product->num_sensors;
+
+	if (!priv->sample.seq) {
+		memcpy(aggr->lowest, values, sizeof(aggr->lowest));
+		memcpy(aggr->highest, values, sizeof(aggr->highest));
+	} else if (changed) {
+		for (i = 0; i < num; i++) {
+			aggr->lowest[i] = min(aggr->lowest[i], values[i]);
+			aggr->highest[i] = max(aggr->highest[i], values[i]);
+		}
+
+		for_each_set_bit(i, restart, num) {
+			aggr->lowest[i] = values[i];
+			aggr->highest[i] = values[i];
+		}
+	}
+
+	for (i = 0; i < num; i++)
+		priv->avg_sum[i] += values[i];
+
+	if (++priv->avg_count < priv->avg_samples)
+		return;
+
+	for (i = 0; i < num; i++) {
+		aggr->average[i] = div_s64(priv->avg_sum[i], priv->avg_count);
+		priv->avg_sum[i] = 0;
+	}
+
+	priv->avg_count = 0;
+	aggr->average_valid = true;
+}
+
+/* Restarts the extremes of count values from first at their current values */
+static void octo_reset_history(struct octo_data *priv, int first, int count)
+{
+	unsigned long flags;
+
+	write_seqlock_irqsave(&priv->lock, flags);
+	memcpy(priv->aggr.lowest + first, priv->sample.sensors + first, count * sizeof(s32));
+	memcpy(priv->aggr.highest + first, priv->sample.sensors + first, count * sizeof(s32));
+	write_sequnlock_irqrestore(&priv->lock, flags);
+}
+
+static void octo_set_average_samples(struct octo_data *priv, unsigned int samples)
+{
+	unsigned long flags;
+
+	write_seqlock_irqsave(&priv->lock, flags);
+	priv->avg_samples = samples;
+	priv->avg_count = 0;
+	memset(priv->avg_sum, 0, sizeof(priv->avg_sum));
+	write_sequnlock_irqrestore(&priv->lock, flags);
+}
+
+static void octo_ring_free(void *buf)
+{
+	vfree(buf);
+}
+
+static int octo_ring_init(struct device *dev, struct octo_ring *ring, u32 num_records,
+			  size_t data_size)
+{
+	struct octo_ring_header *header;
+	size_t records_size;
+
+	if (!num_records)
+		return 0;
+
+	ring->data_size = data_size;
+	ring->record_size = ALIGN(sizeof(struct octo_ring_record) + data_size, 8);
+	ring->num_records = num_records;
+
+	/* The lengths are module parameters, which can be set to anything */
+	if (check_mul_overflow(ring->record_size, (size_t)num_records, &records_size) ||
+	    records_size > SIZE_MAX - 2 * PAGE_SIZE)
+		return -EINVAL;
+
+	ring->size = PAGE_SIZE + PAGE_ALIGN(records_size);
+
+	ring->buf = vmalloc_user(ring->size);
+	if (!ring->buf)
+		return -ENOMEM;
+
+	header = ring->buf;
+	header->version = OCTO_RING_VERSION;
+	header->record_size = ring->record_size;
+	header->num_records = num_records;
+
+	return devm_add_action_or_reset(dev, octo_ring_free, ring->buf);
+}
+
+/* Only called from decode_work, so there is a single writer per ring */
+static void octo_ring_push(struct octo_ring *ring, u64 timestamp, const void *data, size_t len)
+{
+	struct octo_ring_header *header = ring->buf;
+	struct octo_ring_record *record;
+	u32 head;
+
+	if (!ring->buf)
+		return;
+
+	len = min(len, ring->data_size);
+	head = header->head + 1;
+	record = ring->buf + PAGE_SIZE + ring->next * ring->record_size;
+
+	WRITE_ONCE(record->seq, 0);
+	smp_wmb();
+	record->timestamp_ns = timestamp;
+	record->len = len;
+	memcpy(record->data, data, len);
+	smp_wmb();
+	WRITE_ONCE(record->seq, head);
+
+	smp_store_release(&header->head, head);
+
+	if (++ring->next == ring->num_records)
+		ring->next = 0;
+}
+
+static u16 octo_ctrl_checksum(const u8 *buf, unsigned int size)
+{
+	return crc16(0xffff, buf + OCTO_CTRL_CHECKSUM_START, OCTO_CTRL_CHECKSUM_LENGTH(size)) ^
+	       0xffff;
+}
+
+/* Reads the control report, rejecting anything with a broken checksum */
+static int octo_ctrl_fetch(struct octo_data *priv)
+{
+	unsigned int size = priv->product->ctrl_report_size;
+	u8 *buf = priv->ctrl.buf;
+	int ret;
+
+	lockdep_assert_held(&priv->ctrl.lock);
+
+	ret = hid_hw_raw_request(priv->hdev, OCTO_CTRL_REPORT_ID, buf, size, HID_FEATURE_REPORT,
+				 HID_REQ_GET_REPORT);
+	if (ret < 0)
+		return ret;
+	if (ret != size)
+		return -EIO;
+
+	if (octo_ctrl_checksum(buf, size) != get_unaligned_be16(buf + OCTO_CTRL_CHECKSUM(size)))
+		return -EBADMSG;
+
+	return 0;
+}
+
+/* Makes sure the cached control report is valid, fetching it if needed */
+static int octo_ctrl_get(struct octo_data *priv)
+{
+	struct octo_ctrl *ctrl = &priv->ctrl;
+	int ret;
+
+	lockdep_assert_held(&ctrl->lock);
+
+	if (ctrl->valid)
+		return 0;
+
+	ret = octo_ctrl_fetch(priv);
+	if (ret)
+		return ret;
+
+	ctrl->valid = true;
+	ctrl->fetches++;
+
+	return 0;
+}
+
+/* Drops the cached control report along with changes not sent yet */
+static void octo_ctrl_invalidate(struct octo_ctrl *ctrl)
+{
+	lockdep_assert_held(&ctrl->lock);
+
+	ctrl->valid = false;
+	ctrl->dirty = false;
+}
+
+static int octo_ctrl_send(struct octo_data *priv)
+{
+	unsigned int size = priv->product->ctrl_report_size;
+	struct octo_ctrl *ctrl = &priv->ctrl;
+	int ret;
+
+	lockdep_assert_held(&ctrl->lock);
+
+	put_unaligned_be16(octo_ctrl_checksum(ctrl->buf, size), ctrl->buf + OCTO_CTRL_CHECKSUM(size));
+
+	ret = hid_hw_raw_request(priv->hdev, OCTO_CTRL_REPORT_ID, ctrl->buf, size,
+				 HID_FEATURE_REPORT, HID_REQ_SET_REPORT);
+	if (ret < 0)
+		return ret;
+
+	memcpy(ctrl->secondary, octo_secondary_report, sizeof(octo_secondary_report));
+	ret = hid_hw_raw_request(priv->hdev, OCTO_SECONDARY_REPORT_ID, ctrl->secondary,
+				 sizeof(octo_secondary_report), HID_FEATURE_REPORT,
+				 HID_REQ_SET_REPORT);
+
+	return ret < 0 ? ret : 0;
+}
+
+/* Sends all changes made to the cached report since the last flush at once */
+static void octo_ctrl_flush(struct work_struct *work)
+{
+	struct octo_data *priv = container_of(to_delayed_work(work), struct octo_data,
+					      ctrl.flush_work);
+	struct octo_ctrl *ctrl = &priv->ctrl;
+	int ret;
+
+	mutex_lock(&ctrl->lock);
+
+	if (!ctrl->dirty)
+		goto unlock;
+
+	ret = octo_ctrl_send(priv);
+	if (ret) {
+		/* What the device ended up with is unknown, read it again next time */
+		octo_ctrl_invalidate(ctrl);
+		ctrl->errors++;
+		hid_err(priv->hdev, "failed to update control report: %d\n", ret);
+		goto unlock;
+	}
+
+	ctrl->dirty = false;
+	ctrl->flushes++;
+
+unlock:
+	mutex_unlock(&ctrl->lock);
+}
+
+static int octo_pwm_read(struct octo_data *priv, u32 attr, int channel, long *val)
+{
+	struct octo_ctrl *ctrl = &priv->ctrl;
+	const u8 *fan_ctrl;
+	int ret;
+
+	mutex_lock(&ctrl->lock);
+
+	/* Pending changes are already in the cache and reported as applied */
+	ret = octo_ctrl_get(priv);
+	if (ret)
+		goto unlock;
+
+	fan_ctrl = ctrl->buf + priv->product->fan_ctrl_offsets[channel];
+
+	switch (attr) {
+	case hwmon_pwm_input:
+		*val = DIV_ROUND_CLOSEST(get_unaligned_be16(fan_ctrl + OCTO_FAN_CTRL_PWM) * 255,
+					 100 * 100);
+		break;
+	case hwmon_pwm_enable:
+		/* Anything but a fixed duty cycle is controlled by the device itself */
+		*val = fan_ctrl[OCTO_FAN_CTRL_MODE] ? 2 : 1;
+		break;
+	default:
+		ret = -EOPNOTSUPP;
+		break;
+	}
+
+unlock:
+	mutex_unlock(&ctrl->lock);
+
+	return ret;
+}
+
+/*
+ * Only changes the cached report and arms the flush, so that writes to
+ * several channels in quick succession end up in a single control report
+ */
+static int octo_pwm_write(struct octo_data *priv, u32 attr, int channel, long val)
+{
+	struct octo_ctrl *ctrl = &priv->ctrl;
+	u8 *fan_ctrl;
+	int ret;
+
+	switch (attr) {
+	case hwmon_pwm_input:
+		if (val < 0 || val > 255)
+			return -EINVAL;
+		break;
+	case hwmon_pwm_enable:
+		/* Device controlled modes can only be configured in aquasuite */
+		if (val != 1)
+			return -EINVAL;
+		break;
+	default:
+		return -EOPNOTSUPP;
+	}
+
+	mutex_lock(&ctrl->lock);
+
+	ret = octo_ctrl_get(priv);
+	if (ret)
+		goto unlock;
+
+	fan_ctrl = ctrl->buf + priv->product->fan_ctrl_offsets[channel];
+
+	if (attr == hwmon_pwm_input)
+		put_unaligned_be16(DIV_ROUND_CLOSEST(val * 100 * 100, 255),
+				   fan_ctrl + OCTO_FAN_CTRL_PWM);
+	else
+		fan_ctrl[OCTO_FAN_CTRL_MODE] = 0;
+
+	ctrl->dirty = true;
+	ctrl->requests++;
+
+unlock:
+	mutex_unlock(&ctrl->lock);
+
+	if (!ret)
+		schedule_delayed_work(&ctrl->flush_work, OCTO_CTRL_FLUSH_DELAY);
+
+	return ret;
+}
+
+/* Returns the first value and number of values whose history the attribute resets */
+static int octo_reset_history_range(const struct octo_product *product,
+				    enum hwmon_sensor_types type, u32 attr, int channel, int *count)
+{
+	int group;
+
+	switch (type) {
+	case hwmon_chip:
+		switch (attr) {
+		case hwmon_chip_temp_reset_history:
+			group = OCTO_GROUP_TEMP;
+			break;
+		case hwmon_chip_in_reset_history:
+			group = OCTO_GROUP_VOLTAGE;
+			break;
+		case hwmon_chip_curr_reset_history:
+			group = OCTO_GROUP_CURRENT;
+			break;
+		case hwmon_chip_power_reset_history:
+			group = OCTO_GROUP_POWER;
+			break;
+		default:
+			return -EOPNOTSUPP;
+		}
+		*count = product->counts[group];
+		return product->bases[group];
+	case hwmon_temp:
+		if (attr == hwmon_temp_reset_history)
+			group = OCTO_GROUP_TEMP;
+		else
+			return -EOPNOTSUPP;
+		break;
+	case hwmon_in:
+		if (attr == hwmon_in_reset_history)
+			group = OCTO_GROUP_VOLTAGE;
+		else
+			return -EOPNOTSUPP;
+		break;
+	case hwmon_curr:
+		if (attr == hwmon_curr_reset_history)
+			group = OCTO_GROUP_CURRENT;
+		else
+			return -EOPNOTSUPP;
+		break;
+	case hwmon_power:
+		if (attr == hwmon_power_reset_history)
+			group = OCTO_GROUP_POWER;
+		else
+			return -EOPNOTSUPP;
+		break;
+	default:
+		return -EOPNOTSUPP;
+	}
+
+	*count = 1;
+	return product->bases[group] + channel;
+}
+
+static bool octo_heat_load_enabled(const struct octo_product *product)
+{
+	unsigned int temps = product->counts[OCTO_GROUP_TEMP];
+
+	return product->heat_load &&
+	       heat_load_inlet >= 1 && heat_load_inlet <= temps &&
+	       heat_load_outlet >= 1 && heat_load_outlet <= temps &&
+	       heat_load_inlet != heat_load_outlet;
+}
+
+/* First bit of each alarm's channels in the chip's alarms attribute */
+#define OCTO_ALARMS_SHIFT_FAN		0
+#define OCTO_ALARMS_SHIFT_TEMP_MAX	16
+#define OCTO_ALARMS_SHIFT_TEMP_CRIT	24
+
+/* Unset limits never raise an alarm */
+#define OCTO_LIMIT_NONE_MIN		0
+#define OCTO_LIMIT_NONE_MAX		S32_MAX
+
+/* The hwmon attributes of each alarm, which applies to all values of a group */
+static const struct octo_alarm_attr {
+	enum hwmon_sensor_types type;
+	enum octo_group group;
+	u32 limit;
+	u32 alarm;
+	u8 shift;
+} octo_alarm_attrs[OCTO_NUM_ALARMS] = {
+	[OCTO_ALARM_MIN] = {
+		hwmon_fan, OCTO_GROUP_SPEED, hwmon_fan_min, hwmon_fan_alarm,
+		OCTO_ALARMS_SHIFT_FAN,
+	},
+	[OCTO_ALARM_MAX] = {
+		hwmon_temp, OCTO_GROUP_TEMP, hwmon_temp_max, hwmon_temp_max_alarm,
+		OCTO_ALARMS_SHIFT_TEMP_MAX,
+	},
+	[OCTO_ALARM_CRIT] = {
+		hwmon_temp, OCTO_GROUP_TEMP, hwmon_temp_crit, hwmon_temp_crit_alarm,
+		OCTO_ALARMS_SHIFT_TEMP_CRIT,
+	},
+};
+
+/* Maps a limit or alarm attribute to its alarm, telling which of both it is */
+static int octo_alarm_find(enum hwmon_sensor_types type, u32 attr, bool *is_limit)
+{
+	int i;
+
+	for (i = 0; i < OCTO_NUM_ALARMS; i++) {
+		if (octo_alarm_attrs[i].type != type)
+			continue;
+
+		if (octo_alarm_attrs[i].limit == attr || octo_alarm_attrs[i].alarm == attr) {
+			*is_limit = octo_alarm_attrs[i].limit == attr;
+			return i;
+		}
+	}
+
+	return -EOPNOTSUPP;
+}
+
+static umode_t octo_is_visible(const void *data, enum hwmon_sensor_types type, u32 attr,
+				 int channel)
+{
+	const struct octo_data *priv = data;
+	const struct octo_product *product = priv->product;
+	int count, index;
+	bool is_limit;
+
+	if (type == hwmon_chip &&
+	    (attr == hwmon_chip_samples || attr == hwmon_chip_update_interval))
+		return 0644;
+
+	if (type == hwmon_pwm)
+		return 0644;
+
+	/* Devices without values of a type have no use for resetting their history */
+	index = octo_reset_history_range(product, type, attr, channel, &count);
+	if (index >= 0)
+		return count ? 0200 : 0;
+
+	/* Decided once at registration, normally from the first report */
+	if (type == hwmon_temp && hide_disconnected && READ_ONCE(priv->sample.seq) &&
+	    test_bit(product->bases[OCTO_GROUP_TEMP] + channel, priv->sample.disconnected))
+		return 0;
+
+	if (type == hwmon_power && product->heat_load &&
+	    channel == product->heat_load - product->bases[OCTO_GROUP_POWER] &&
+	    !octo_heat_load_enabled(product))
+		return 0;
+
+	if (octo_alarm_find(type, attr, &is_limit) >= 0 && is_limit)
+		return 0644;
+
+	return 0444;
+}
+
+/* Maps a hwmon attribute to the kind of value it reports */
+static int octo_value_kind(enum hwmon_sensor_types type, u32 attr)
+{
+	switch (type) {
+	case hwmon_temp:
+		switch (attr) {
+		case hwmon_temp_input:
+			return OCTO_VALUE_INPUT;
+		case hwmon_temp_lowest:
+			return OCTO_VALUE_LOWEST;
+		case hwmon_temp_highest:
+			return OCTO_VALUE_HIGHEST;
+		}
+		break;
+	case hwmon_fan:
+		if (attr == hwmon_fan_input)
+			return OCTO_VALUE_INPUT;
+		break;
+	case hwmon_power:
+		switch (attr) {
+		case hwmon_power_input:
+			return OCTO_VALUE_INPUT;
+		case hwmon_power_input_lowest:
+			return OCTO_VALUE_LOWEST;
+		case hwmon_power_input_highest:
+			return OCTO_VALUE_HIGHEST;
+		case hwmon_power_average:
+			return OCTO_VALUE_AVERAGE;
+		}
+		break;
+	case hwmon_in:
+		switch (attr) {
+		case hwmon_in_input:
+			return OCTO_VALUE_INPUT;
+		case hwmon_in_lowest:
+			return OCTO_VALUE_LOWEST;
+		case hwmon_in_highest:
+			return OCTO_VALUE_HIGHEST;
+		case hwmon_in_average:
+			return OCTO_VALUE_AVERAGE;
+		}
+		break;
+	case hwmon_curr:
+		switch (attr) {
+		case hwmon_curr_input:
+			return OCTO_VALUE_INPUT;
+		case hwmon_curr_lowest:
+			return OCTO_VALUE_LOWEST;
+		case hwmon_curr_highest:
+			return OCTO_VALUE_HIGHEST;
+		case hwmon_curr_average:
+			return OCTO_VALUE_AVERAGE;
+		}
+		break;
+	default:
+		break;
+	}
+
+	return -EOPNOTSUPP;
+}
+
+#define OCTO_GROUP_CASE(p, type, name, config) \
+	case hwmon_##type: \
+		return product->bases[OCTO_GROUP_##name] + channel;
+
+/* Maps a hwmon channel to its index in struct octo_sample->sensors */
+static int octo_sensor_index(const struct octo_product *product, enum hwmon_sensor_types type,
+			     int channel)
+{
+	switch (type) {
+	OCTO_SENSOR_GROUPS(OCTO_GROUP_CASE, OCTO)
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
+static void octo_idle_work(struct work_struct *work)
+{
+	struct octo_data *priv = container_of(to_delayed_work(work), struct octo_data,
+					      idle_work);
+	unsigned long timeout = msecs_to_jiffies(idle_close);
+	unsigned long idle;
+
+	mutex_lock(&priv->stream_lock);
+
+	if (!priv->stream_open)
+		goto unlock;
+
+	idle = jiffies - READ_ONCE(priv->read_stats.last_read);
+	if (idle < timeout) {
+		schedule_delayed_work(&priv->idle_work, timeout - idle);
+		goto unlock;
+	}
+
+	hid_hw_close(priv->hdev);
+	WRITE_ONCE(priv->stream_open, false);
+
+unlock:
+	mutex_unlock(&priv->stream_lock);
+}
+
+/*
+ * Notes the read and, if the stream was closed while idle, reopens it and
+ * waits until the last report goes stale for a fresh report to serve
+ */
+static void octo_stream_get(struct octo_data *priv)
+{
+	bool reopened = false;
+	u32 seq = 0;
+
+	if (!idle_close)
+		return;
+
+	if (READ_ONCE(priv->read_stats.last_read) != jiffies)
+		WRITE_ONCE(priv->read_stats.last_read, jiffies);
+
+	if (likely(READ_ONCE(priv->stream_open)))
+		return;
+
+	mutex_lock(&priv->stream_lock);
+
+	if (!priv->stream_open && !hid_hw_open(priv->hdev)) {
+		seq = READ_ONCE(priv->sample.seq);
+		WRITE_ONCE(priv->stream_open, true);
+		schedule_delayed_work(&priv->idle_work, msecs_to_jiffies(idle_close));
+		reopened = true;
+	}
+
+	mutex_unlock(&priv->stream_lock);
+
+	if (reopened)
+		wait_event_interruptible_timeout(priv->wait, READ_ONCE(priv->sample.seq) != seq,
+						 msecs_to_jiffies(octo_stale_timeout(priv)));
+}
+
+/* Counts from probe, so it keeps increasing while values go stale */
+static int octo_energy_read(struct octo_data *priv, int channel, long *val)
+{
+	unsigned int seq;
+	u64 energy;
+
+	if (channel >= priv->product->num_energy)
+		return -EOPNOTSUPP;
+
+	octo_stream_get(priv);
+
+	do {
+		seq = read_seqbegin(&priv->lock);
+		energy = priv->sample.energy[channel];
+	} while (read_seqretry(&priv->lock, seq));
+
+	/*
+	 * A 32 bit long only holds 2147 J, wrap within its positive range
+	 * so that collectors taking differences keep working
+	 */
+	*val = energy & LONG_MAX;
+
+	return 0;
+}
+
+/* Folds all alarms into one bitmask, so that a single attribute can be waited on */
+static long octo_chip_alarms(struct octo_data *priv)
+{
+	const struct octo_product *product = priv->product;
+	struct octo_sample sample;
+	long alarms = 0;
+	int alarm, i;
+
+	octo_get_sample(priv, &sample);
+
+	for (alarm = 0; alarm < OCTO_NUM_ALARMS; alarm++) {
+		const struct octo_alarm_attr *attr = &octo_alarm_attrs[alarm];
+		int base = product->bases[attr->group];
+
+		for_each_set_bit(i, sample.alarms[alarm], product->num_sensors)
+			alarms |= BIT(attr->shift + i - base);
+	}
+
+	return alarms;
+}
+
+/* dL/h per l/h of the flow, hwmon reports it in whole l/h as it always did */
+#define OCTO_FLOW_DIVISOR	10
+#define OCTO_FLOW_LABEL		"Flow speed [l/h]"
+
+/* The flow is the first speed value of devices with a flow sensor */
+static bool octo_is_flow(const struct octo_product *product, int index)
+{
+	return product->flow_speed && index == product->bases[OCTO_GROUP_SPEED];
+}
+
+static int octo_alarm_read(struct octo_data *priv, int alarm, bool is_limit, int channel,
+			   long *val)
+{
+	int index = priv->product->bases[octo_alarm_attrs[alarm].group] + channel;
+	unsigned int seq;
+
+	if (is_limit) {
+		*val = READ_ONCE(priv->limits[alarm][index]);
+		if (octo_is_flow(priv->product, index))
+			*val /= OCTO_FLOW_DIVISOR;
+		return 0;
+	}
+
+	octo_stream_get(priv);
+
+	do {
+		seq = read_seqbegin(&priv->lock);
+		*val = test_bit(index, priv->sample.alarms[alarm]);
+	} while (read_seqretry(&priv->lock, seq));
+
+	return 0;
+}
+
+static int octo_read(struct device *dev, enum hwmon_sensor_types type, u32 attr, int channel,
+		       long *val)
+{
+	struct octo_data *priv = dev_get_drvdata(dev);
+	int index, kind, alarm, ret;
+	bool is_limit;
+
+	if (type == hwmon_chip && attr == hwmon_chip_samples) {
+		*val = READ_ONCE(priv->avg_samples);
+		return 0;
+	}
+
+	if (type == hwmon_chip && attr == hwmon_chip_update_interval) {
+		*val = READ_ONCE(priv->update_interval);
+		return 0;
+	}
+
+	if (type == hwmon_chip && attr == hwmon_chip_alarms) {
+		octo_stream_get(priv);
+		*val = octo_chip_alarms(priv);
+		return 0;
+	}
+
+	if (type == hwmon_pwm)
+		return octo_pwm_read(priv, attr, channel, val);
+
+	if (type == hwmon_energy && attr == hwmon_energy_input)
+		return octo_energy_read(priv, channel, val);
+
+	alarm = octo_alarm_find(type, attr, &is_limit);
+	if (alarm >= 0)
+		return octo_alarm_read(priv, alarm, is_limit, channel, val);
+
+	kind = octo_value_kind(type, attr);
+	if (kind < 0)
+		return kind;
+
+	index = octo_sensor_index(priv->product, type, channel);
+	if (index < 0)
+		return index;
+
+	octo_stream_get(priv);
+
+	ret = octo_read_value(priv, kind, index, val);
+	if (!ret && type == hwmon_fan && octo_is_flow(priv->product, index))
+		*val /= OCTO_FLOW_DIVISOR;
+
+	return ret;
+}
+
+static int octo_read_string(struct device *dev, enum hwmon_sensor_types type, u32 attr,
+			      int channel, const char **str)
+{
+	struct octo_data *priv = dev_get_drvdata(dev);
+	int index = octo_sensor_index(priv->product, type, channel);
+
+	if (type == hwmon_energy) {
+		*str = priv->product->energy_labels[channel];
+		return 0;
+	}
+
+	if (index < 0)
+		return index;
+
+	/* The value of the first fan channel differs from the others in unit */
+	if (type == hwmon_fan && octo_is_flow(priv->product, index)) {
+		*str = OCTO_FLOW_LABEL;
+		return 0;
+	}
+
+	*str = priv->product->labels[index];
+
+	return 0;
+}
+
+/* Lets collectors judge freshness themselves, in particular with serve_stale set */
+static ssize_t sample_age_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	struct octo_data *priv = dev_get_drvdata(dev);
+	struct octo_sample sample;
+
+	octo_get_sample(priv, &sample);
+	if (!sample.seq)
+		return -ENODATA;
+
+	return sysfs_emit(buf, "%u\n", jiffies_to_msecs(jiffies - sample.updated));
+}
+static DEVICE_ATTR_RO(sample_age);
+
+/* Identifies the device independently of the order it was enumerated in */
+static ssize_t serial_number_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	struct octo_data *priv = dev_get_drvdata(dev);
+	struct octo_sample sample;
+
+	octo_get_sample(priv, &sample);
+	if (!sample.seq)
+		return -ENODATA;
+
+	return sysfs_emit(buf, "%05u-%05u\n", priv->serial_number[0], priv->serial_number[1]);
+}
+static DEVICE_ATTR_RO(serial_number);
+
+/* Counted by the device, a change between readings means it was power cycled */
+static ssize_t power_cycles_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	struct octo_data *priv = dev_get_drvdata(dev);
+	struct octo_sample sample;
+
+	octo_get_sample(priv, &sample);
+	if (!sample.seq)
+		return -ENODATA;
+
+	return sysfs_emit(buf, "%u\n", priv->power_cycles);
+}
+static DEVICE_ATTR_RO(power_cycles);
+
+/* Seconds since probe, which is what the energy counters cover */
+static ssize_t uptime_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	struct octo_data *priv = dev_get_drvdata(dev);
+
+	return sysfs_emit(buf, "%llu\n", div_u64(ktime_get_ns() - priv->probed_ns, NSEC_PER_SEC));
+}
+static DEVICE_ATTR_RO(uptime);
+
+/* The flow at the full 0.1 l/h resolution of the device, in dL/h */
+static ssize_t flow1_input_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	struct octo_data *priv = dev_get_drvdata(dev);
+	long val;
+	int ret;
+
+	octo_stream_get(priv);
+
+	ret = octo_read_value(priv, OCTO_VALUE_INPUT, priv->product->bases[OCTO_GROUP_SPEED],
+			      &val);
+	if (ret)
+		return ret;
+
+	return sysfs_emit(buf, "%ld\n", val);
+}
+static DEVICE_ATTR_RO(flow1_input);
+
+static struct attribute *octo_attrs[] = {
+	&dev_attr_sample_age.attr,
+	&dev_attr_serial_number.attr,
+	&dev_attr_power_cycles.attr,
+	&dev_attr_uptime.attr,
+	&dev_attr_flow1_input.attr,
+	NULL
+};
+
+static umode_t octo_attr_is_visible(struct kobject *kobj, struct attribute *attr, int n)
+{
+	struct octo_data *priv = dev_get_drvdata(kobj_to_dev(kobj));
+
+	if (attr == &dev_attr_flow1_input.attr && !priv->product->flow_speed)
+		return 0;
+
+	return attr->mode;
+}
+
+static const struct attribute_group octo_group = {
+	.attrs = octo_attrs,
+	.is_visible = octo_attr_is_visible,
+};
+__ATTRIBUTE_GROUPS(octo);
+
+static int octo_write(struct device *dev, enum hwmon_sensor_types type, u32 attr, int channel,
+		      long val)
+{
+	struct octo_data *priv = dev_get_drvdata(dev);
+	int first, count, alarm;
+	bool is_limit;
+
+	if (type == hwmon_chip && attr == hwmon_chip_samples) {
+		if (val < 1 || val > OCTO_AVERAGE_SAMPLES_MAX)
+			return -EINVAL;
+
+		octo_set_average_samples(priv, val);
+		return 0;
+	}
+
+	/* The report rate isn't known to be configurable, this only sets what is expected */
+	if (type == hwmon_chip && attr == hwmon_chip_update_interval) {
+		if (val < OCTO_UPDATE_INTERVAL_MIN || val > OCTO_UPDATE_INTERVAL_MAX)
+			return -EINVAL;
+
+		WRITE_ONCE(priv->update_interval, val);
+		return 0;
+	}
+
+	if (type == hwmon_pwm)
+		return octo_pwm_write(priv, attr, channel, val);
+
+	/* Applies from the next report on */
+	alarm = octo_alarm_find(type, attr, &is_limit);
+	if (alarm >= 0 && is_limit) {
+		first = priv->product->bases[octo_alarm_attrs[alarm].group] + channel;
+		if (octo_is_flow(priv->product, first))
+			val = clamp_val(val, 0, S32_MAX / OCTO_FLOW_DIVISOR) * OCTO_FLOW_DIVISOR;
+		else if (alarm == OCTO_ALARM_MIN)
+			val = clamp_val(val, 0, S32_MAX);
+		else
+			val = clamp_val(val, S32_MIN, S32_MAX);
+
+		WRITE_ONCE(priv->limits[alarm][first], val);
+		return 0;
+	}
+
+	first = octo_reset_history_range(priv->product, type, attr, channel, &count);
+	if (first < 0)
+		return first;
+
+	octo_reset_history(priv, first, count);
+
+	return 0;
+}
+
+static const struct hwmon_ops octo_hwmon_ops = {
+	.is_visible = octo_is_visible,
+	.read = octo_read,
+	.read_string = octo_read_string,
+	.write = octo_write,
+};
+
+#define OCTO_FIELD_ENTRY(is_signed_, label, off, mul) \
+	{ .offset = (off), .is_signed = (is_signed_), .multiplier = (mul) },
+#define OCTO_GROUP_FIELDS(p, type, name, config) \
+	p##_##name##_SENSORS(OCTO_FIELD_ENTRY, OCTO_SIGNED_##name)
+
+#define OCTO_LABEL_ENTRY(arg, label, off, mul)	label,
+#define OCTO_GROUP_LABELS(p, type, name, config)	p##_##name##_SENSORS(OCTO_LABEL_ENTRY, 0)
+
+#define OCTO_LABEL_SIZE_ENTRY(arg, label, off, mul)	sizeof(label) +
+#define OCTO_GROUP_LABELS_SIZE(p, type, name, config) \
+	p##_##name##_SENSORS(OCTO_LABEL_SIZE_ENTRY, 0)
+
+#define OCTO_CONFIG_ENTRY(config, label, off, mul)	config,
+
+/* Like HWMON_CHANNEL_INFO(), with one config entry per value of the list */
+#define OCTO_GROUP_INFO(p, stype, name, cfg) \
+	&(const struct hwmon_channel_info) { \
+		.type = hwmon_##stype, \
+		.config = (const u32 []) { p##_##name##_SENSORS(OCTO_CONFIG_ENTRY, cfg) 0 }, \
+	},
+
+#define OCTO_CTRL_OFFSET_ENTRY(arg, off)	off,
+#define OCTO_PWM_CONFIG_ENTRY(arg, off)	HWMON_PWM_INPUT | HWMON_PWM_ENABLE,
+
+/* Decode table, labels, fan control offsets and hwmon channels of device p */
+#define OCTO_PRODUCT_TABLES(p, lower) \
+static const struct octo_field lower##_fields[] = { \
+	OCTO_SENSOR_GROUPS(OCTO_GROUP_FIELDS, p) \
+}; \
+static const char *const lower##_labels[] = { \
+	OCTO_SENSOR_GROUPS(OCTO_GROUP_LABELS, p) \
+}; \
+static const char *const lower##_energy_labels[] = { \
+	p##_ENERGY_SENSORS(OCTO_LABEL_ENTRY, 0) \
+}; \
+static const u16 lower##_fan_ctrl_offsets[] = { \
+	p##_FAN_CTRL(OCTO_CTRL_OFFSET_ENTRY, 0) \
+}; \
+static const struct hwmon_channel_info *lower##_info[] = { \
+	HWMON_CHANNEL_INFO(chip, HWMON_C_SAMPLES | HWMON_C_UPDATE_INTERVAL | HWMON_C_ALARMS | \
+			   HWMON_C_TEMP_RESET_HISTORY | HWMON_C_IN_RESET_HISTORY | \
+			   HWMON_C_CURR_RESET_HISTORY | \
+			   HWMON_C_POWER_RESET_HISTORY), \
+	OCTO_SENSOR_GROUPS(OCTO_GROUP_INFO, p) \
+	OCTO_GROUP_INFO(p, energy, ENERGY, HWMON_E_INPUT | HWMON_E_LABEL) \
+	&(const struct hwmon_channel_info) { \
+		.type = hwmon_pwm, \
+		.config = (const u32 []) { p##_FAN_CTRL(OCTO_PWM_CONFIG_ENTRY, 0) 0 }, \
+	}, \
+	NULL \
+}; \
+static const struct hwmon_chip_info lower##_chip_info = { \
+	.ops = &octo_hwmon_ops, \
+	.info = lower##_info, \
+}; \
+static_assert(OCTO_NUM_SENSORS(p) <= OCTO_MAX_SENSORS); \
+static_assert(OCTO_COUNT(p, ENERGY) == \
+	      (p##_SENSOR_TOTAL_POWER ? p##_SENSOR_TOTAL_POWER - OCTO_BASE_POWER(p) + 1 : 0)); \
+static_assert(OCTO_COUNT(p, SPEED) <= OCTO_ALARMS_SHIFT_TEMP_MAX - OCTO_ALARMS_SHIFT_FAN); \
+static_assert(OCTO_COUNT(p, TEMP) <= OCTO_ALARMS_SHIFT_TEMP_CRIT - OCTO_ALARMS_SHIFT_TEMP_MAX); \
+static_assert(p##_STATUS_REPORT_MIN_SIZE - p##_SENSOR_REGION_START <= OCTO_MAX_SENSOR_REGION)
+
+OCTO_PRODUCT_TABLES(OCTO, octo);
+OCTO_PRODUCT_TABLES(QUADRO, quadro);
+OCTO_PRODUCT_TABLES(D5NEXT, d5next);
+OCTO_PRODUCT_TABLES(FARBWERK360, farbwerk360);
+
+#define OCTO_GROUP_COUNT(p, type, name, config)	OCTO_COUNT(p, name),
+#define OCTO_GROUP_BASE(p, type, name, config)	OCTO_BASE_##name(p),
+
+#define OCTO_PRODUCT(p, lower, hwmon_name) { \
+	.name = hwmon_name, \
+	.chip_info = &lower##_chip_info, \
+	.fields = lower##_fields, \
+	.labels = lower##_labels, \
+	.labels_size = OCTO_SENSOR_GROUPS(OCTO_GROUP_LABELS_SIZE, p) 0, \
+	.counts = { OCTO_SENSOR_GROUPS(OCTO_GROUP_COUNT, p) }, \
+	.bases = { OCTO_SENSOR_GROUPS(OCTO_GROUP_BASE, p) }, \
+	.num_sensors = OCTO_NUM_SENSORS(p), \
+	.status_report_min_size = p##_STATUS_REPORT_MIN_SIZE, \
+	.sensor_region_start = p##_SENSOR_REGION_START, \
+	.flow_speed = p##_FLOW_SPEED, \
+	.total_power = p##_SENSOR_TOTAL_POWER, \
+	.heat_load = p##_SENSOR_HEAT_LOAD, \
+	.num_energy = OCTO_COUNT(p, ENERGY), \
+	.energy_labels = lower##_energy_labels, \
+	.ctrl_report_size = p##_CTRL_REPORT_SIZE, \
+	.num_fans = ARRAY_SIZE(lower##_fan_ctrl_offsets), \
+	.fan_ctrl_offsets = lower##_fan_ctrl_offsets, \
+}
+
+/* Selected by the driver_data of the matching hid_device_id */
+static const struct octo_product octo_products[] = {
+	[OCTO_PRODUCT_OCTO] = OCTO_PRODUCT(OCTO, octo, "octo"),
+	[OCTO_PRODUCT_QUADRO] = OCTO_PRODUCT(QUADRO, quadro, "quadro"),
+	[OCTO_PRODUCT_D5NEXT] = OCTO_PRODUCT(D5NEXT, d5next, "d5next"),
+	[OCTO_PRODUCT_FARBWERK360] = OCTO_PRODUCT(FARBWERK360, farbwerk360, "farbwerk360"),
+};
+
+/* Computes the derived values from a freshly decoded sample */
+static void octo_derive(struct octo_data *priv, const u8 *data)
+{
+	const struct octo_product *product = priv->product;
+	s32 *sensors = priv->sample.sensors;
+	s64 total = 0, heat;
+	s32 delta;
+	int i;
+
+	if (!product->total_power)
+		return;
+
+	/* The total follows the power values it sums up */
+	for (i = product->bases[OCTO_GROUP_POWER]; i < product->total_power; i++)
+		total += sensors[i];
+	sensors[product->total_power] = min_t(s64, total, S32_MAX);
+
+	if (!octo_heat_load_enabled(product))
+		return;
+
+	/* Without both temperatures there is nothing to estimate */
+	__assign_bit(product->heat_load, priv->sample.disconnected,
+		     test_bit(product->bases[OCTO_GROUP_TEMP] + heat_load_inlet - 1,
+			      priv->sample.disconnected) ||
+		     test_bit(product->bases[OCTO_GROUP_TEMP] + heat_load_outlet - 1,
+			      priv->sample.disconnected));
+
+	/*
+	 * Flow in 0.1 l/h times temperature delta in millidegrees, scaled to
+	 * microwatts: 0.1 l/h = 1 / 36000 l/s and 1 mK = 1 / 1000 K
+	 */
+	delta = sensors[product->bases[OCTO_GROUP_TEMP] + heat_load_outlet - 1] -
+		sensors[product->bases[OCTO_GROUP_TEMP] + heat_load_inlet - 1];
+	heat = div_s64((s64)get_unaligned_be16(data + product->flow_speed) * delta *
+		       OCTO_COOLANT_HEAT_CAPACITY, 36);
+	sensors[product->heat_load] = clamp_t(s64, heat, S32_MIN, S32_MAX);
+}
+
+#if IS_REACHABLE(CONFIG_IIO_KFIFO_BUF)
+
+/*
+ * IIO channel type of each group, hwmon units map to IIO ones through the
+ * scale. Only fans are left in the speed group, see octo_iio_num_channels().
+ */
+static const enum iio_chan_type octo_iio_types[OCTO_NUM_GROUPS] = {
+	[OCTO_GROUP_TEMP] = IIO_TEMP,
+	[OCTO_GROUP_SPEED] = IIO_ANGL_VEL,
+	[OCTO_GROUP_POWER] = IIO_POWER,
+	[OCTO_GROUP_VOLTAGE] = IIO_VOLTAGE,
+	[OCTO_GROUP_CURRENT] = IIO_CURRENT,
+};
+
+static int octo_iio_read_raw(struct iio_dev *indio_dev, struct iio_chan_spec const *chan,
+			     int *val, int *val2, long mask)
+{
+	if (mask != IIO_CHAN_INFO_SCALE)
+		return -EINVAL;
+
+	switch (chan->type) {
+	case IIO_ANGL_VEL:
+		/* RPM to rad/s */
+		*val = 0;
+		*val2 = 104719755;
+		return IIO_VAL_INT_PLUS_NANO;
+	case IIO_POWER:
+		/* uW to mW */
+		*val = 1;
+		*val2 = 1000;
+		return IIO_VAL_FRACTIONAL;
+	default:
+		/* Temperatures, voltages and currents are in milli units in both */
+		*val = 1;
+		return IIO_VAL_INT;
+	}
+}
+
+static int octo_iio_read_label(struct iio_dev *indio_dev, struct iio_chan_spec const *chan,
+			       char *label)
+{
+	struct octo_data *priv = *(struct octo_data **)iio_priv(indio_dev);
+
+	return sysfs_emit(label, "%s\n", priv->product->labels[chan->address]);
+}
+
+static const struct iio_info octo_iio_info = {
+	.read_raw = octo_iio_read_raw,
+	.read_label = octo_iio_read_label,
+};
+
+/* IIO has no type for a volumetric flow, which is left out of the buffer */
+static int octo_iio_num_channels(const struct octo_product *product)
+{
+	return product->num_sensors - !!product->flow_speed;
+}
+
+/*
+ * Registers an IIO device with one buffered channel per value but the flow,
+ * in sensors[] order, followed by a timestamp. There are no values to read
+ * directly, only scan elements, all of which are always captured and
+ * demuxed by the IIO core to those enabled.
+ */
+static int octo_iio_init(struct octo_data *priv)
+{
+	const struct octo_product *product = priv->product;
+	int num_channels = octo_iio_num_channels(product);
+	struct device *dev = &priv->hdev->dev;
+	struct iio_chan_spec *channels;
+	struct iio_dev *indio_dev;
+	unsigned long *scan_masks;
+	int group, channel, index, i = 0;
+	int ret;
+
+	if (!iio)
+		return 0;
+
+	indio_dev = devm_iio_device_alloc(dev, sizeof(priv));
+	if (!indio_dev)
+		return -ENOMEM;
+
+	channels = devm_kcalloc(dev, num_channels + 1, sizeof(*channels), GFP_KERNEL);
+	/* The available masks end with an empty one */
+	scan_masks = devm_kcalloc(dev, 2 * BITS_TO_LONGS(num_channels + 1),
+				  sizeof(*scan_masks), GFP_KERNEL);
+	if (!channels || !scan_masks)
+		return -ENOMEM;
+
+	for (group = 0; group < OCTO_NUM_GROUPS; group++) {
+		for (channel = 0; channel < product->counts[group]; channel++) {
+			index = product->bases[group] + channel;
+			if (octo_is_flow(product, index))
+				continue;
+
+			channels[i] = (struct iio_chan_spec) {
+				.type = octo_iio_types[group],
+				.indexed = 1,
+				.channel = channel,
+				.address = index,
+				.info_mask_shared_by_type = BIT(IIO_CHAN_INFO_SCALE),
+				.scan_index = i,
+				.scan_type = {
+					.sign = 's',
+					.realbits = 32,
+					.storagebits = 32,
+					.endianness = IIO_CPU,
+				},
+			};
+			i++;
+		}
+	}
+	channels[i] = (struct iio_chan_spec)IIO_CHAN_SOFT_TIMESTAMP(i);
+	bitmap_set(scan_masks, 0, num_channels);
+
+	*(struct octo_data **)iio_priv(indio_dev) = priv;
+	indio_dev->name = product->name;
+	indio_dev->info = &octo_iio_info;
+	indio_dev->channels = channels;
+	indio_dev->num_channels = num_channels + 1;
+	indio_dev->available_scan_masks = scan_masks;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 19, 0)
+	ret = devm_iio_kfifo_buffer_setup(dev, indio_dev, NULL);
+#else
+	ret = devm_iio_kfifo_buffer_setup(dev, indio_dev, INDIO_BUFFER_SOFTWARE, NULL);
+#endif
+	if (ret)
+		return ret;
+
+	ret = devm_iio_device_register(dev, indio_dev);
+	if (ret)
+		return ret;
+
+	priv->iio = indio_dev;
+
+	return 0;
+}
+
+static void octo_iio_push(struct octo_data *priv)
+{
+	const struct octo_product *product = priv->product;
+	int i, n = 0;
+
+	if (!priv->iio || !iio_buffer_enabled(priv->iio))
+		return;
+
+	for (i = 0; i < product->num_sensors; i++)
+		if (!octo_is_flow(product, i))
+			priv->iio_scan.sensors[n++] = priv->sample.sensors[i];
+	iio_push_to_buffers_with_timestamp(priv->iio, &priv->iio_scan,
+					   iio_get_time_ns(priv->iio));
+}
+
+#else
+
+static int octo_iio_init(struct octo_data *priv)
+{
+	return 0;
+}
+
+static void octo_iio_push(struct octo_data *priv)
+{
+}
+
+#endif
+
+/*
+ * Adds the energy used since the previous report at the power it reported.
+ * Longer gaps, e.g. while the stream was closed, count until the report
+ * went stale, as nothing is known about the power after that. Bounding
+ * the gap to 32 bits of microseconds also keeps the product from
+ * overflowing.
+ */
+static void octo_integrate_energy(struct octo_data *priv, u64 delta_ns)
+{
+	const struct octo_product *product = priv->product;
+	const s32 *power = priv->sample.sensors + product->bases[OCTO_GROUP_POWER];
+	u64 delta_us = div_u64(delta_ns, NSEC_PER_USEC);
+	u32 rem;
+	int i;
+
+	delta_us = min3(delta_us, (u64)octo_stale_timeout(priv) * USEC_PER_MSEC, (u64)U32_MAX);
+
+	for (i = 0; i < product->num_energy; i++) {
+		u64 uw_us = priv->energy_rem[i] + (u64)max(power[i], 0) * delta_us;
+
+		priv->sample.energy[i] += div_u64_rem(uw_us, USEC_PER_SEC, &rem);
+		priv->energy_rem[i] = rem;
+	}
+}
+
+/* Checks the values of an alarm's group against their limits, flagging those that changed */
+static void octo_check_alarm(struct octo_data *priv, int alarm, unsigned long *changed)
+{
+	const struct octo_product *product = priv->product;
+	int first = product->bases[octo_alarm_attrs[alarm].group];
+	int last = first + product->counts[octo_alarm_attrs[alarm].group];
+	unsigned long *alarms = priv->sample.alarms[alarm];
+	int i;
+
+	for (i = first; i < last; i++) {
+		s32 limit = READ_ONCE(priv->limits[alarm][i]);
+		s32 value = priv->sample.sensors[i];
+		bool active;
+
+		if (test_bit(i, priv->sample.disconnected))
+			active = false;
+		else if (alarm == OCTO_ALARM_MIN)
+			active = value < limit;
+		else
+			active = value > limit;
+
+		if (active != test_bit(i, alarms)) {
+			__assign_bit(i, alarms, active);
+			__set_bit(i, changed);
+		}
+	}
+}
+
+/* Wakes up pollers of the alarms that were raised or cleared, and of the chip's alarms */
+static void octo_notify_alarms(struct octo_data *priv, struct device *hwmon_dev,
+			       unsigned long (*changed)[BITS_TO_LONGS(OCTO_MAX_SENSORS)])
+{
+	const struct octo_product *product = priv->product;
+	bool any = false;
+	int alarm, i;
+
+	for (alarm = 0; alarm < OCTO_NUM_ALARMS; alarm++) {
+		const struct octo_alarm_attr *attr = &octo_alarm_attrs[alarm];
+
+		for_each_set_bit(i, changed[alarm], product->num_sensors) {
+			hwmon_notify_event(hwmon_dev, attr->type, attr->alarm,
+					   i - product->bases[attr->group]);
+			any = true;
+		}
+	}
+
+	if (any)
+		hwmon_notify_event(hwmon_dev, hwmon_chip, hwmon_chip_alarms, 0);
+}
+
+/* Decodes a status report received at the given time, from decode_work and for replays */
+static void octo_process_report(struct octo_data *priv, const u8 *data, int size, u64 received)
+{
+	const struct octo_product *product = priv->product;
+	const u8 *regs = data + product->sensor_region_start;
+	unsigned int regs_size = product->status_report_min_size - product->sensor_region_start;
+	unsigned long alarms_changed[OCTO_NUM_ALARMS][BITS_TO_LONGS(OCTO_MAX_SENSORS)] = {};
+	DECLARE_BITMAP(restart, OCTO_MAX_SENSORS);
+	struct device *hwmon_dev = NULL;
+	unsigned long flags;
+	u64 start, elapsed;
+	bool changed, first;
+	int i;
+
+	if (unlikely(size < priv->status_report_size)) {
+		priv->stats.reports_short++;
+		return;
+	}
+
+	start = ktime_get_ns();
+
+	octo_ring_push(&priv->reports, received, data, size);
+
+	/*
+	 * Info provided with every report, but fixed until the device is
+	 * power cycled, which also re-enumerates it
+	 */
+
+	if (!priv->sample.seq) {
+		priv->serial_number[0] = get_unaligned_be16(data + OCTO_SERIAL_FIRST_PART);
+		priv->serial_number[1] = get_unaligned_be16(data + OCTO_SERIAL_SECOND_PART);
+
+		priv->firmware_version = get_unaligned_be16(data + OCTO_FIRMWARE_VERSION);
+		priv->power_cycles = get_unaligned_be32(data + OCTO_POWER_CYCLES);
+
+		schedule_work(&priv->register_work);
+	}
+
+	/*
+	 * Sensor readings, published as one consistent sample. When no
+	 * register changed only the sample's freshness is updated.
+	 */
+
+	changed = !priv->sample.seq ||
+		  memcmp(priv->sensor_regs, regs, regs_size);
+	if (changed)
+		memcpy(priv->sensor_regs, regs, regs_size);
+	else
+		priv->stats.reports_unchanged++;
+
+	write_seqlock_irqsave(&priv->lock, flags);
+
+	/* With the previous sample's power, before it is replaced */
+	if (priv->stats.reports)
+		octo_integrate_energy(priv, received - priv->stats.last_report_ns);
+
+	if (changed) {
+		bitmap_copy(restart, priv->sample.disconnected, OCTO_MAX_SENSORS);
+
+		for (i = 0; i < product->num_sensors; i++) {
+			const struct octo_field *field = &product->fields[i];
+			s32 raw = get_unaligned_be16(data + field->offset);
+
+			/* Only temperature sensors can be disconnected */
+			if (field->is_signed) {
+				__assign_bit(i, priv->sample.disconnected,
+					     raw == OCTO_TEMP_DISCONNECTED);
+				raw = (s16)raw;
+			}
+
+			priv->sample.sensors[i] = raw * field->multiplier;
+		}
+
+		octo_derive(priv, data);
+
+		/* Both values still disconnected and those connected just now */
+		bitmap_or(restart, restart, priv->sample.disconnected, OCTO_MAX_SENSORS);
+	}
+
+	octo_aggregate(priv, changed, restart);
+
+	/* Also for unchanged reports, the limits may have changed */
+	for (i = 0; i < OCTO_NUM_ALARMS; i++)
+		octo_check_alarm(priv, i, alarms_changed[i]);
+
+	first = !priv->sample.seq;
+
+	/* Unregistering waits for this work to finish after setting removing */
+	if (!priv->removing)
+		hwmon_dev = READ_ONCE(priv->hwmon_dev);
+
+	priv->sample.updated = jiffies;
+	priv->sample.seq++;
+
+	write_sequnlock_irqrestore(&priv->lock, flags);
+
+	/*
+	 * Values are valid from now on, don't wait for the timeout. Only after
+	 * seq is published, for octo_is_visible() to see the first sample.
+	 */
+	if (first && !priv->removing)
+		mod_delayed_work(system_wq, &priv->hwmon_work, 0);
+
+	wake_up_interruptible(&priv->wait);
+
+	if (hwmon_dev)
+		octo_notify_alarms(priv, hwmon_dev, alarms_changed);
+
+	octo_ring_push(&priv->history, received, priv->sample.sensors,
+		       sizeof(priv->sample.sensors));
+	octo_iio_push(priv);
+
+	elapsed = ktime_get_ns() - start;
+
+	if (priv->stats.reports)
+		octo_hist_add(priv->stats.gap_ms_hist,
+			      div_u64(received - priv->stats.last_report_ns, NSEC_PER_MSEC));
+	octo_hist_add(priv->stats.decode_ns_hist, elapsed);
+
+	priv->stats.reports++;
+	priv->stats.last_report_ns = received;
+	priv->stats.decode_ns_total += elapsed;
+	if (elapsed > priv->stats.decode_ns_max)
+		priv->stats.decode_ns_max = elapsed;
+
+	trace_octo_sample(priv->hdev, priv->sample.seq, changed, priv->sample.sensors,
+			  product->num_sensors, elapsed);
+}
+
+/*
+ * Decodes the latest status report copied by octo_raw_event(), which keeps
+ * the HID event path down to a copy. Aggregates, history and waking up
+ * readers all happen here.
+ */
+static void octo_decode_work(struct work_struct *work)
+{
+	struct octo_data *priv = container_of(work, struct octo_data, decode_work);
+	unsigned long flags;
+	u64 received;
+	int size;
+
+	spin_lock_irqsave(&priv->pending_lock, flags);
+	size = priv->pending_size;
+	received = priv->pending_ns;
+	swap(priv->pending, priv->decode_buf);
+	priv->pending_size = 0;
+	spin_unlock_irqrestore(&priv->pending_lock, flags);
+
+	if (size)
+		octo_process_report(priv, priv->decode_buf, size, received);
+}
+
+static int octo_raw_event(struct hid_device *hdev, struct hid_report *report, u8 *data, int size)
+{
+	struct octo_data *priv = hid_get_drvdata(hdev);
+	unsigned long flags;
+
+	/* Only pay for the timestamp while someone is listening */
+	if (trace_octo_report_enabled()) {
+		u64 now = ktime_get_ns();
+
+		trace_octo_report(hdev, report->id, size,
+				  priv->stats.last_event_ns ? now - priv->stats.last_event_ns : 0);
+		priv->stats.last_event_ns = now;
+	}
+
+	if (report->id != OCTO_STATUS_REPORT_ID) {
+		priv->stats.reports_ignored++;
+		return 0;
+	}
+
+	if (unlikely(size < priv->status_report_size)) {
+		priv->stats.reports_short++;
+		return 0;
+	}
+
+	/* Only the latest report is decoded if decode_work falls behind */
+	spin_lock_irqsave(&priv->pending_lock, flags);
+	if (priv->pending_size)
+		priv->stats.reports_coalesced++;
+	priv->pending_size = min_t(unsigned int, size, priv->status_report_len);
+	priv->pending_ns = ktime_get_ns();
+	memcpy(priv->pending, data, priv->pending_size);
+	spin_unlock_irqrestore(&priv->pending_lock, flags);
+
+	queue_work(octo_wq, &priv->decode_work);
+
+	return 0;
+}
+
+static void octo_limits_init(struct octo_data *priv)
+{
+	int i;
+
+	for (i = 0; i < OCTO_MAX_SENSORS; i++) {
+		priv->limits[OCTO_ALARM_MIN][i] = OCTO_LIMIT_NONE_MIN;
+		priv->limits[OCTO_ALARM_MAX][i] = OCTO_LIMIT_NONE_MAX;
+		priv->limits[OCTO_ALARM_CRIT][i] = OCTO_LIMIT_NONE_MAX;
+	}
+}
+
+#if defined(CONFIG_DEBUG_FS) || defined(CONFIG_AQUACOMPUTER_OCTO_KUNIT_TEST)
+
+/*
+ * Sets up zeroed device state to decode reports of product without a device
+ * behind, for replays and tests. It starts out as if a report had been
+ * decoded already, so identity parsing and registration are skipped. The
+ * rings stay unallocated.
+ */
+static void octo_scratch_init(struct octo_data *scratch, struct hid_device *hdev,
+			      const struct octo_product *product)
+{
+	seqlock_init(&scratch->lock);
+	init_waitqueue_head(&scratch->wait);
+	scratch->avg_samples = OCTO_AVERAGE_SAMPLES;
+	scratch->update_interval = OCTO_UPDATE_INTERVAL;
+	octo_limits_init(scratch);
+	scratch->hdev = hdev;
+	scratch->product = product;
+	scratch->status_report_size = product->status_report_min_size;
+	scratch->removing = true;
+	scratch->sample.seq = 1;
+}
+
+#endif
+
+#ifdef CONFIG_DEBUG_FS
+
+static struct dentry *octo_debugfs_root;
+static struct dentry *octo_debugfs_by_serial;
+
+static int serial_number_debugfs_show(struct seq_file *seqf, void *unused)
+{
+	struct octo_data *priv = seqf->private;
+
+	seq_printf(seqf, "%05u-%05u\n", priv->serial_number[0], priv->serial_number[1]);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(serial_number_debugfs);
+
+static int firmware_version_show(struct seq_file *seqf, void *unused)
+{
+	struct octo_data *priv = seqf->private;
+
+	seq_printf(seqf, "%u\n", priv->firmware_version);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(firmware_version);
+
+static int power_cycles_debugfs_show(struct seq_file *seqf, void *unused)
+{
+	struct octo_data *priv = seqf->private;
+
+	seq_printf(seqf, "%u\n", priv->power_cycles);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(power_cycles_debugfs);
+
+/* Remembers which sample an open "sensors" file has last returned, for poll() */
+struct octo_reader {
+	struct octo_data *priv;
+	u32 seq;
+};
+
+static int sensors_open(struct inode *inode, struct file *file)
+{
+	struct octo_reader *reader;
+
+	reader = kzalloc(sizeof(*reader), GFP_KERNEL);
+	if (!reader)
+		return -ENOMEM;
+
+	reader->priv = inode->i_private;
+	reader->seq = READ_ONCE(reader->priv->sample.seq);
+	file->private_data = reader;
+
+	return 0;
+}
+
+static int sensors_release(struct inode *inode, struct file *file)
+{
+	kfree(file->private_data);
+
+	return 0;
+}
+
+static ssize_t sensors_read(struct file *file, char __user *buf, size_t count, loff_t *ppos)
+{
+	struct octo_reader *reader = file->private_data;
+	struct octo_data *priv = reader->priv;
+	struct octo_snapshot snap = {
+		.version = OCTO_SNAPSHOT_VERSION,
+	};
+	struct octo_sample sample;
+
+	octo_stream_get(priv);
+	octo_get_sample(priv, &sample);
+
+	snap.seq = sample.seq;
+	snap.age_ms = jiffies_to_msecs(jiffies - sample.updated);
+	snap.serial_number[0] = priv->serial_number[0];
+	snap.serial_number[1] = priv->serial_number[1];
+	snap.power_cycles = priv->power_cycles;
+	snap.firmware_version = priv->firmware_version;
+	snap.product = priv->hdev->product;
+	snap.num_sensors = priv->product->num_sensors;
+	memcpy(snap.counts, priv->product->counts, sizeof(snap.counts));
+	memcpy(snap.sensors, sample.sensors, sizeof(snap.sensors));
+
+	reader->seq = sample.seq;
+
+	return simple_read_from_buffer(buf, count, ppos, &snap, sizeof(snap));
+}
+
+/* Readable once a sample newer than the last one read has arrived */
+static __poll_t sensors_poll(struct file *file, poll_table *wait)
+{
+	struct octo_reader *reader = file->private_data;
+	struct octo_data *priv = reader->priv;
+
+	poll_wait(file, &priv->wait, wait);
+
+	if (READ_ONCE(priv->sample.seq) != reader->seq)
+		return EPOLLIN | EPOLLRDNORM;
+
+	return 0;
+}
+
+static const struct file_operations sensors_fops = {
+	.owner = THIS_MODULE,
+	.open = sensors_open,
+	.release = sensors_release,
+	.read = sensors_read,
+	.poll = sensors_poll,
+	.llseek = default_llseek,
+};
+
+/*
+ * The text files have one line per value, holding the label and a few
+ * numbers. Their seq_file buffer is sized for the longest possible output
+ * when opened, so it never has to be reallocated and a reader keeping the
+ * file open and reading it again from offset 0 doesn't allocate at all.
+ */
+#define OCTO_TEXT_HEADER_SIZE	128
+#define OCTO_TEXT_NUMBER_SIZE	sizeof(" -2147483648")
+
+static size_t octo_text_size(const struct octo_product *product, unsigned int numbers)
+{
+	return OCTO_TEXT_HEADER_SIZE + product->labels_size +
+	       product->num_sensors * (sizeof(":\n") + numbers * OCTO_TEXT_NUMBER_SIZE);
+}
+
+static int sensors_text_show(struct seq_file *seqf, void *unused)
+{
+	struct octo_data *priv = seqf->private;
+	struct octo_sample sample;
+	int i;
+
+	octo_get_sample(priv, &sample);
+
+	seq_printf(seqf, "age_ms %u\n", jiffies_to_msecs(jiffies - sample.updated));
+
+	for (i = 0; i < priv->product->num_sensors; i++)
+		seq_printf(seqf, "%s: %d\n", priv->product->labels[i], sample.sensors[i]);
+
+	return 0;
+}
+
+static int sensors_text_open(struct inode *inode, struct file *file)
+{
+	struct octo_data *priv = inode->i_private;
+
+	return single_open_size(file, sensors_text_show, priv, octo_text_size(priv->product, 1));
+}
+
+static const struct file_operations sensors_text_fops = {
+	.owner = THIS_MODULE,
+	.open = sensors_text_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static void octo_get_aggregates(struct octo_data *priv, struct octo_aggregates *aggr)
+{
+	unsigned int seq;
+
+	do {
+		seq = read_seqbegin(&priv->lock);
+		*aggr = priv->aggr;
+	} while (read_seqretry(&priv->lock, seq));
+}
+
+/* Also covers the fans, for which hwmon has no attributes describing past values */
+static int aggregates_show(struct seq_file *seqf, void *unused)
+{
+	struct octo_data *priv = seqf->private;
+	struct octo_aggregates aggr;
+	int i;
+
+	octo_get_aggregates(priv, &aggr);
+
+	seq_puts(seqf, "label: lowest highest average\n");
+
+	for (i = 0; i < priv->product->num_sensors; i++) {
+		seq_printf(seqf, "%s: %d %d ", priv->product->labels[i], aggr.lowest[i],
+			   aggr.highest[i]);
+		if (aggr.average_valid)
+			seq_printf(seqf, "%d\n", aggr.average[i]);
+		else
+			seq_puts(seqf, "-\n");
+	}
+
+	return 0;
+}
+
+static int aggregates_open(struct inode *inode, struct file *file)
+{
+	struct octo_data *priv = inode->i_private;
+
+	return single_open_size(file, aggregates_show, priv, octo_text_size(priv->product, 3));
+}
+
+static const struct file_operations aggregates_fops = {
+	.owner = THIS_MODULE,
+	.open = aggregates_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static void octo_hist_show(struct seq_file *seqf, const char *name, const u32 *hist)
+{
+	int i;
+
+	seq_printf(seqf, "%s:", name);
+	for (i = 0; i < OCTO_HIST_BUCKETS; i++)
+		seq_printf(seqf, " %u", hist[i]);
+	seq_putc(seqf, '\n');
+}
+
+static int stats_show(struct seq_file *seqf, void *unused)
+{
+	struct octo_data *priv = seqf->private;
+	struct octo_stats *stats = &priv->stats;
+	u64 reports = READ_ONCE(stats->reports);
+
+	seq_printf(seqf, "reports: %llu\n", reports);
+	seq_printf(seqf, "reports_ignored: %llu\n", READ_ONCE(stats->reports_ignored));
+	seq_printf(seqf, "reports_short: %llu\n", READ_ONCE(stats->reports_short));
+	seq_printf(seqf, "reports_coalesced: %llu\n", READ_ONCE(stats->reports_coalesced));
+	seq_printf(seqf, "reports_unchanged: %llu\n", READ_ONCE(stats->reports_unchanged));
+	seq_printf(seqf, "decode_ns_avg: %llu\n",
+		   reports ? div64_u64(READ_ONCE(stats->decode_ns_total), reports) : 0);
+	seq_printf(seqf, "decode_ns_max: %llu\n", READ_ONCE(stats->decode_ns_max));
+	seq_printf(seqf, "reads: %ld\n", atomic_long_read(&priv->read_stats.reads));
+	seq_printf(seqf, "reads_stale: %ld\n", atomic_long_read(&priv->read_stats.reads_stale));
+
+	mutex_lock(&priv->ctrl.lock);
+	seq_printf(seqf, "ctrl_requests: %u\n", priv->ctrl.requests);
+	seq_printf(seqf, "ctrl_fetches: %u\n", priv->ctrl.fetches);
+	seq_printf(seqf, "ctrl_flushes: %u\n", priv->ctrl.flushes);
+	seq_printf(seqf, "ctrl_errors: %u\n", priv->ctrl.errors);
+	mutex_unlock(&priv->ctrl.lock);
+
+	/* Bucket n holds the values in [2^(n-1), 2^n), the last one everything above */
+	octo_hist_show(seqf, "decode_ns_hist", stats->decode_ns_hist);
+	octo_hist_show(seqf, "gap_ms_hist", stats->gap_ms_hist);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(stats);
+
+/*
+ * Writing status reports as read from hidraw, back to back, decodes them
+ * replay_loops times on a scratch copy of the device state, leaving the
+ * live values alone. Reading returns the time taken per report and the
+ * values decoded from the last one, in the format of sensors_text.
+ */
+static int replay_show(struct seq_file *seqf, void *unused)
+{
+	struct octo_data *priv = seqf->private;
+	int i;
+
+	mutex_lock(&priv->replay_lock);
 
-#define DRIVER_NAME			"aquacomputer-octo"
+	seq_printf(seqf, "reports: %llu\n", priv->replay_reports);
+	seq_printf(seqf, "reports_unchanged: %llu\n", priv->replay_unchanged);
+	seq_printf(seqf, "ns_per_report: %llu\n",
+		   priv->replay_reports ? div64_u64(priv->replay_ns, priv->replay_reports) : 0);
 
-#define OCTO_STATUS_REPORT_ID	0x01
-#define OCTO_STATUS_UPDATE_INTERVAL	(2 * HZ) /* In seconds */
+	for (i = 0; priv->replay_reports && i < priv->product->num_sensors; i++)
+		seq_printf(seqf, "%s: %d\n", priv->product->labels[i], priv->replay_sensors[i]);
 
-/* Register offsets for the Octo */
+	mutex_unlock(&priv->replay_lock);
 
-#define OCTO_SERIAL_FIRST_PART	3
-#define OCTO_SERIAL_SECOND_PART	5
-#define OCTO_FIRMWARE_VERSION	13
-#define OCTO_POWER_CYCLES		24
+	return 0;
+}
 
-#define OCTO_TEMP1			61
-#define OCTO_TEMP2			63
-#define OCTO_TEMP3			65
-#define OCTO_TEMP4			67
+static int replay_open(struct inode *inode, struct file *file)
+{
+	struct octo_data *priv = inode->i_private;
 
-#define OCTO_FLOW_SPEED		123
-#define OCTO_FAN1_SPEED		133
-#define OCTO_FAN2_SPEED		146
-#define OCTO_FAN3_SPEED		159
-#define OCTO_FAN4_SPEED		172
-#define OCTO_FAN5_SPEED		185
-#define OCTO_FAN6_SPEED		198
-#define OCTO_FAN7_SPEED		211
-#define OCTO_FAN8_SPEED		224
-		
-#define OCTO_FAN1_POWER		131
-#define OCTO_FAN2_POWER		144
-#define OCTO_FAN3_POWER		157
-#define OCTO_FAN4_POWER		170
-#define OCTO_FAN5_POWER		183
-#define OCTO_FAN6_POWER		196
-#define OCTO_FAN7_POWER		209
-#define OCTO_FAN8_POWER		222
+	return single_open_size(file, replay_show, priv, octo_text_size(priv->product, 1));
+}
 
-#define OCTO_VOLTAGE			117
-#define OCTO_FAN1_VOLTAGE		127
-#define OCTO_FAN2_VOLTAGE		140
-#define OCTO_FAN3_VOLTAGE		153
-#define OCTO_FAN4_VOLTAGE		166
-#define OCTO_FAN5_VOLTAGE		179
-#define OCTO_FAN6_VOLTAGE		192
-#define OCTO_FAN7_VOLTAGE		205
-#define OCTO_FAN8_VOLTAGE		218
-
-#define OCTO_FAN1_CURRENT		129
-#define OCTO_FAN2_CURRENT		142
-#define OCTO_FAN3_CURRENT		155
-#define OCTO_FAN4_CURRENT		168
-#define OCTO_FAN5_CURRENT		181
-#define OCTO_FAN6_CURRENT		194
-#define OCTO_FAN7_CURRENT		207
-#define OCTO_FAN8_CURRENT		220
-
-/* Labels for provided values */
-
-#define L_TEMP1				"Temp1"
-#define L_TEMP2				"Temp2"
-#define L_TEMP3				"Temp3"
-#define L_TEMP4				"Temp4"
-
-#define L_FLOW_SPEED		"Flow speed [l/h]"
-#define L_FAN1_SPEED		"Fan1 speed"
-#define L_FAN2_SPEED		"Fan2 speed"
-#define L_FAN3_SPEED		"Fan3 speed"
-#define L_FAN4_SPEED		"Fan4 speed"
-#define L_FAN5_SPEED		"Fan5 speed"
-#define L_FAN6_SPEED		"Fan6 speed"
-#define L_FAN7_SPEED		"Fan7 speed"
-#define L_FAN8_SPEED		"Fan8 speed"
-
-#define L_FAN1_POWER		"Fan1 power"
-#define L_FAN2_POWER		"Fan2 power"
-#define L_FAN3_POWER		"Fan3 power"
-#define L_FAN4_POWER		"Fan4 power"
-#define L_FAN5_POWER		"Fan5 power"
-#define L_FAN6_POWER		"Fan6 power"
-#define L_FAN7_POWER		"Fan7 power"
-#define L_FAN8_POWER		"Fan8 power"
-
-#define L_OCTO_VOLTAGE		"VCC"
-#define L_FAN1_VOLTAGE		"Fan1 voltage"
-#define L_FAN2_VOLTAGE		"Fan2 voltage"
-#define L_FAN3_VOLTAGE		"Fan3 voltage"
-#define L_FAN4_VOLTAGE		"Fan4 voltage"
-#define L_FAN5_VOLTAGE		"Fan5 voltage"
-#define L_FAN6_VOLTAGE		"Fan6 voltage"
-#define L_FAN7_VOLTAGE		"Fan7 voltage"
-#define L_FAN8_VOLTAGE		"Fan8 voltage"
-
-#define L_FAN1_CURRENT		"Fan1 current"
-#define L_FAN2_CURRENT		"Fan2 current"
-#define L_FAN3_CURRENT		"Fan3 current"
-#define L_FAN4_CURRENT		"Fan4 current"
-#define L_FAN5_CURRENT		"Fan1 current"
-#define L_FAN6_CURRENT		"Fan2 current"
-#define L_FAN7_CURRENT		"Fan3 current"
-#define L_FAN8_CURRENT		"Fan4 current"
-
-static const char *const label_temps[] = {
-	L_TEMP1,
-	L_TEMP2,
-	L_TEMP3,
-	L_TEMP4,
-};
-
-static const char *const label_speeds[] = {
-	L_FLOW_SPEED,
-	L_FAN1_SPEED,
-	L_FAN2_SPEED,
-	L_FAN3_SPEED,
-	L_FAN4_SPEED,
-	L_FAN5_SPEED,
-	L_FAN6_SPEED,
-	L_FAN7_SPEED,
-	L_FAN8_SPEED,
-};
-
-static const char *const label_power[] = {
-	L_FAN1_POWER,
-	L_FAN2_POWER,
-	L_FAN3_POWER,
-	L_FAN4_POWER,
-	L_FAN5_POWER,
-	L_FAN6_POWER,
-	L_FAN7_POWER,
-	L_FAN8_POWER,
-};
-
-static const char *const label_voltages[] = {
-	L_OCTO_VOLTAGE,
-	L_FAN1_VOLTAGE,
-	L_FAN2_VOLTAGE,
-	L_FAN3_VOLTAGE,
-	L_FAN4_VOLTAGE,
-	L_FAN5_VOLTAGE,
-	L_FAN6_VOLTAGE,
-	L_FAN7_VOLTAGE,
-	L_FAN8_VOLTAGE,
-};
-
-static const char *const label_current[] = {
-	L_FAN1_CURRENT,
-	L_FAN2_CURRENT,
-	L_FAN3_CURRENT,
-	L_FAN4_CURRENT,
-	L_FAN5_CURRENT,
-	L_FAN6_CURRENT,
-	L_FAN7_CURRENT,
-	L_FAN8_CURRENT,
-};
+/* Status reports accepted by a single write, a minute of them at 1 Hz */
+#define OCTO_REPLAY_MAX_REPORTS	60
 
-struct octo_data {
-	struct hid_device *hdev;
-	struct device *hwmon_dev;
-	struct dentry *debugfs;
-	s32 temp_input[4];
-	u16 speed_input[9];
-	u32 power_input[8];
-	u16 voltage_input[9];
-	u16 current_input[8];
-	u32 serial_number[2];
-	u16 firmware_version;
-	u32 power_cycles; /* How many times the device was powered on */
-	unsigned long updated;
+static ssize_t replay_write(struct file *file, const char __user *buf, size_t count,
+			    loff_t *ppos)
+{
+	struct octo_data *priv = ((struct seq_file *)file->private_data)->private;
+	unsigned int len = priv->status_report_len;
+	struct octo_data *scratch;
+	u64 start, elapsed;
+	size_t offset;
+	u8 *reports;
+	u32 loop;
+
+	if (!count || count % len || count / len > OCTO_REPLAY_MAX_REPORTS)
+		return -EINVAL;
+
+	reports = vmemdup_user(buf, count);
+	if (IS_ERR(reports))
+		return PTR_ERR(reports);
+
+	scratch = kzalloc(sizeof(*scratch), GFP_KERNEL);
+	if (!scratch) {
+		kvfree(reports);
+		return -ENOMEM;
+	}
+
+	octo_scratch_init(scratch, priv->hdev, priv->product);
+	scratch->update_interval = priv->update_interval;
+	memcpy(scratch->limits, priv->limits, sizeof(scratch->limits));
+
+	mutex_lock(&priv->replay_lock);
+
+	start = ktime_get_ns();
+	for (loop = 0; loop < priv->replay_loops; loop++) {
+		for (offset = 0; offset < count; offset += len)
+			octo_process_report(scratch, reports + offset, len, start);
+		cond_resched();
+	}
+	elapsed = ktime_get_ns() - start;
+
+	priv->replay_reports = scratch->stats.reports;
+	priv->replay_unchanged = scratch->stats.reports_unchanged;
+	priv->replay_ns = elapsed;
+	memcpy(priv->replay_sensors, scratch->sample.sensors, sizeof(priv->replay_sensors));
+
+	mutex_unlock(&priv->replay_lock);
+
+	kfree(scratch);
+	kvfree(reports);
+
+	return count;
+}
+
+static const struct file_operations replay_fops = {
+	.owner = THIS_MODULE,
+	.open = replay_open,
+	.read = seq_read,
+	.write = replay_write,
+	.llseek = seq_lseek,
+	.release = single_release,
 };
 
-static umode_t octo_is_visible(const void *data, enum hwmon_sensor_types type, u32 attr,
-				 int channel)
+/*
+ * Any write drops the cached control report, e.g. after changing settings in
+ * aquasuite. Changes made before are sent first instead of being lost.
+ */
+static ssize_t ctrl_invalidate_write(struct file *file, const char __user *buf, size_t count,
+				     loff_t *ppos)
 {
-	return 0444;
+	struct octo_data *priv = file->private_data;
+
+	flush_delayed_work(&priv->ctrl.flush_work);
+
+	mutex_lock(&priv->ctrl.lock);
+	octo_ctrl_invalidate(&priv->ctrl);
+	mutex_unlock(&priv->ctrl.lock);
+
+	return count;
 }
 
-static int octo_read(struct device *dev, enum hwmon_sensor_types type, u32 attr, int channel,
-		       long *val)
+static const struct file_operations ctrl_invalidate_fops = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.write = ctrl_invalidate_write,
+	.llseek = noop_llseek,
+};
+
+/* Ring files are created unsafe so they can be mmapped, guard against removal by hand */
+static ssize_t ring_read(struct file *file, char __user *buf, size_t count, loff_t *ppos)
 {
-	struct octo_data *priv = dev_get_drvdata(dev);
+	struct octo_ring *ring = file->private_data;
+	ssize_t ret;
 
-	if (time_after(jiffies, priv->updated + OCTO_STATUS_UPDATE_INTERVAL))
-		return -ENODATA;
+	ret = debugfs_file_get(file->f_path.dentry);
+	if (ret)
+		return ret;
 
-	switch (type) {
-	case hwmon_temp:
-		*val = priv->temp_input[channel];
-		break;
-	case hwmon_fan:
-		*val = priv->speed_input[channel];
-		break;
-	case hwmon_power:
-		*val = priv->power_input[channel];
-		break;
-	case hwmon_in:
-		*val = priv->voltage_input[channel];
-		break;
-	case hwmon_curr:
-		*val = priv->current_input[channel];
-		break;
-	default:
-		return -EOPNOTSUPP;
-	}
+	ret = simple_read_from_buffer(buf, count, ppos, ring->buf, ring->size);
 
-	return 0;
+	debugfs_file_put(file->f_path.dentry);
+
+	return ret;
 }
 
-static int octo_read_string(struct device *dev, enum hwmon_sensor_types type, u32 attr,
-			      int channel, const char **str)
+static int ring_mmap(struct file *file, struct vm_area_struct *vma)
 {
-	switch (type) {
-	case hwmon_temp:
-		*str = label_temps[channel];
-		break;
-	case hwmon_fan:
-		*str = label_speeds[channel];
-		break;
-	case hwmon_power:
-		*str = label_power[channel];
-		break;
-	case hwmon_in:
-		*str = label_voltages[channel];
-		break;
-	case hwmon_curr:
-		*str = label_current[channel];
-		break;
-	default:
-		return -EOPNOTSUPP;
-	}
+	struct octo_ring *ring = file->private_data;
+	int ret;
 
-	return 0;
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+
+	ret = debugfs_file_get(file->f_path.dentry);
+	if (ret)
+		return ret;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+	vm_flags_clear(vma, VM_MAYWRITE);
+#else
+	vma->vm_flags &= ~VM_MAYWRITE;
+#endif
+	ret = remap_vmalloc_range(vma, ring->buf, vma->vm_pgoff);
+
+	debugfs_file_put(file->f_path.dentry);
+
+	return ret;
 }
 
-static const struct hwmon_ops octo_hwmon_ops = {
-	.is_visible = octo_is_visible,
-	.read = octo_read,
-	.read_string = octo_read_string,
+static const struct file_operations ring_fops = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.read = ring_read,
+	.mmap = ring_mmap,
+	.llseek = default_llseek,
 };
 
-static const struct hwmon_channel_info *octo_info[] = {
-	HWMON_CHANNEL_INFO(temp, HWMON_T_INPUT | HWMON_T_LABEL, HWMON_T_INPUT | HWMON_T_LABEL,
-	 			HWMON_T_INPUT | HWMON_T_LABEL, HWMON_T_INPUT | HWMON_T_LABEL),
-	HWMON_CHANNEL_INFO(fan, HWMON_F_INPUT | HWMON_F_LABEL, HWMON_F_INPUT | HWMON_F_LABEL, 
-				HWMON_F_INPUT | HWMON_F_LABEL, HWMON_F_INPUT | HWMON_F_LABEL, 
-				HWMON_F_INPUT | HWMON_F_LABEL, HWMON_F_INPUT | HWMON_F_LABEL, 
-				HWMON_F_INPUT | HWMON_F_LABEL, HWMON_F_INPUT | HWMON_F_LABEL, 
-				HWMON_F_INPUT | HWMON_F_LABEL),
-	HWMON_CHANNEL_INFO(power, HWMON_P_INPUT | HWMON_P_LABEL, HWMON_P_INPUT | HWMON_P_LABEL, 
-				HWMON_P_INPUT | HWMON_P_LABEL, HWMON_P_INPUT | HWMON_P_LABEL, 
-				HWMON_P_INPUT | HWMON_P_LABEL, HWMON_P_INPUT | HWMON_P_LABEL,
-				HWMON_P_INPUT | HWMON_P_LABEL, HWMON_P_INPUT | HWMON_P_LABEL),
-	HWMON_CHANNEL_INFO(in, HWMON_I_INPUT | HWMON_I_LABEL, HWMON_I_INPUT | HWMON_I_LABEL, 
-				HWMON_I_INPUT | HWMON_I_LABEL, HWMON_I_INPUT | HWMON_I_LABEL, 
-				HWMON_I_INPUT | HWMON_I_LABEL, HWMON_I_INPUT | HWMON_I_LABEL,
-			   	HWMON_I_INPUT | HWMON_I_LABEL, HWMON_I_INPUT | HWMON_I_LABEL, 
-			   	HWMON_I_INPUT | HWMON_I_LABEL),
-	HWMON_CHANNEL_INFO(curr, HWMON_C_INPUT | HWMON_C_LABEL, HWMON_C_INPUT | HWMON_C_LABEL, 
-				HWMON_C_INPUT | HWMON_C_LABEL, HWMON_C_INPUT | HWMON_C_LABEL, 
-				HWMON_C_INPUT | HWMON_C_LABEL, HWMON_C_INPUT | HWMON_C_LABEL,
-				HWMON_C_INPUT | HWMON_C_LABEL, HWMON_C_INPUT | HWMON_C_LABEL),
-	NULL
-};
+static void octo_debugfs_init(struct octo_data *priv)
+{
+	priv->debugfs = debugfs_create_dir(dev_name(&priv->hdev->dev), octo_debugfs_root);
+	debugfs_create_file("serial_number", 0444, priv->debugfs, priv, &serial_number_debugfs_fops);
+	debugfs_create_file("firmware_version", 0444, priv->debugfs, priv, &firmware_version_fops);
+	debugfs_create_file("power_cycles", 0444, priv->debugfs, priv, &power_cycles_debugfs_fops);
+	debugfs_create_file("sensors", 0444, priv->debugfs, priv, &sensors_fops);
+	debugfs_create_file("sensors_text", 0444, priv->debugfs, priv, &sensors_text_fops);
+
+	debugfs_create_file("aggregates", 0444, priv->debugfs, priv, &aggregates_fops);
+	debugfs_create_file("stats", 0444, priv->debugfs, priv, &stats_fops);
+	debugfs_create_file("ctrl_invalidate", 0200, priv->debugfs, priv, &ctrl_invalidate_fops);
+	debugfs_create_file("replay", 0600, priv->debugfs, priv, &replay_fops);
+	debugfs_create_u32("replay_loops", 0600, priv->debugfs, &priv->replay_loops);
+
+	if (priv->history.buf)
+		debugfs_create_file_unsafe("history", 0444, priv->debugfs, &priv->history,
+					   &ring_fops);
+	if (priv->reports.buf)
+		debugfs_create_file_unsafe("reports", 0444, priv->debugfs, &priv->reports,
+					   &ring_fops);
+}
 
-static const struct hwmon_chip_info octo_chip_info = {
-	.ops = &octo_hwmon_ops,
-	.info = octo_info,
-};
+/* Points <serial> in by-serial to the directory of the device */
+static void octo_debugfs_link(struct octo_data *priv)
+{
+	char name[16], target[64];
 
-static int octo_raw_event(struct hid_device *hdev, struct hid_report *report, u8 *data, int size)
+	scnprintf(name, sizeof(name), "%05u-%05u", priv->serial_number[0],
+		  priv->serial_number[1]);
+	scnprintf(target, sizeof(target), "../%s", dev_name(&priv->hdev->dev));
+
+	priv->by_serial = debugfs_create_symlink(name, octo_debugfs_by_serial, target);
+}
+
+/* One line per device, so collectors find all of them with a single read */
+static int devices_show(struct seq_file *seqf, void *unused)
 {
 	struct octo_data *priv;
+	int bkt;
 
-	if (report->id != OCTO_STATUS_REPORT_ID)
-		return 0;
-
-	priv = hid_get_drvdata(hdev);
-
-	/* Info provided with every report */
-
-	priv->serial_number[0] = get_unaligned_be16(data + OCTO_SERIAL_FIRST_PART);
-	priv->serial_number[1] = get_unaligned_be16(data + OCTO_SERIAL_SECOND_PART);
-
-	priv->firmware_version = get_unaligned_be16(data + OCTO_FIRMWARE_VERSION);
-	priv->power_cycles = get_unaligned_be32(data + OCTO_POWER_CYCLES);
-
-	/* Sensor readings */
-
-	priv->temp_input[0] = get_unaligned_be16(data + OCTO_TEMP1) * 10;
-	priv->temp_input[1] = get_unaligned_be16(data + OCTO_TEMP2) * 10;
-	priv->temp_input[2] = get_unaligned_be16(data + OCTO_TEMP3) * 10;
-	priv->temp_input[3] = get_unaligned_be16(data + OCTO_TEMP4) * 10;
-
-	priv->speed_input[0] = get_unaligned_be16(data + OCTO_FLOW_SPEED) / 10;
-	priv->speed_input[1] = get_unaligned_be16(data + OCTO_FAN1_SPEED);
-	priv->speed_input[2] = get_unaligned_be16(data + OCTO_FAN2_SPEED);
-	priv->speed_input[3] = get_unaligned_be16(data + OCTO_FAN3_SPEED);
-	priv->speed_input[4] = get_unaligned_be16(data + OCTO_FAN4_SPEED);
-	priv->speed_input[5] = get_unaligned_be16(data + OCTO_FAN5_SPEED);
-	priv->speed_input[6] = get_unaligned_be16(data + OCTO_FAN6_SPEED);
-	priv->speed_input[7] = get_unaligned_be16(data + OCTO_FAN7_SPEED);
-	priv->speed_input[8] = get_unaligned_be16(data + OCTO_FAN8_SPEED);
-
-
-	priv->power_input[0] = get_unaligned_be16(data + OCTO_FAN1_POWER) * 10000;
-	priv->power_input[1] = get_unaligned_be16(data + OCTO_FAN2_POWER) * 10000;
-	priv->power_input[2] = get_unaligned_be16(data + OCTO_FAN3_POWER) * 10000;
-	priv->power_input[3] = get_unaligned_be16(data + OCTO_FAN4_POWER) * 10000;
-	priv->power_input[4] = get_unaligned_be16(data + OCTO_FAN5_POWER) * 10000;
-	priv->power_input[5] = get_unaligned_be16(data + OCTO_FAN6_POWER) * 10000;
-	priv->power_input[6] = get_unaligned_be16(data + OCTO_FAN7_POWER) * 10000;
-	priv->power_input[7] = get_unaligned_be16(data + OCTO_FAN8_POWER) * 10000;
-
-	priv->voltage_input[0] = get_unaligned_be16(data + OCTO_VOLTAGE) * 10;
-	priv->voltage_input[1] = get_unaligned_be16(data + OCTO_FAN1_VOLTAGE) * 10;
-	priv->voltage_input[2] = get_unaligned_be16(data + OCTO_FAN2_VOLTAGE) * 10;
-	priv->voltage_input[3] = get_unaligned_be16(data + OCTO_FAN3_VOLTAGE) * 10;
-	priv->voltage_input[4] = get_unaligned_be16(data + OCTO_FAN4_VOLTAGE) * 10;
-	priv->voltage_input[5] = get_unaligned_be16(data + OCTO_FAN5_VOLTAGE) * 10;
-	priv->voltage_input[6] = get_unaligned_be16(data + OCTO_FAN6_VOLTAGE) * 10;
-	priv->voltage_input[7] = get_unaligned_be16(data + OCTO_FAN7_VOLTAGE) * 10;
-	priv->voltage_input[8] = get_unaligned_be16(data + OCTO_FAN8_VOLTAGE) * 10;
-
-	priv->current_input[0] = get_unaligned_be16(data + OCTO_FAN1_CURRENT);
-	priv->current_input[1] = get_unaligned_be16(data + OCTO_FAN2_CURRENT);
-	priv->current_input[2] = get_unaligned_be16(data + OCTO_FAN3_CURRENT);
-	priv->current_input[3] = get_unaligned_be16(data + OCTO_FAN4_CURRENT);
-	priv->current_input[4] = get_unaligned_be16(data + OCTO_FAN5_CURRENT);
-	priv->current_input[5] = get_unaligned_be16(data + OCTO_FAN6_CURRENT);
-	priv->current_input[6] = get_unaligned_be16(data + OCTO_FAN7_CURRENT);
-	priv->current_input[7] = get_unaligned_be16(data + OCTO_FAN8_CURRENT);
-
-	priv->updated = jiffies;
+	mutex_lock(&octo_devices_lock);
+	hash_for_each(octo_devices, bkt, priv, node)
+		seq_printf(seqf, "%05u-%05u %s %u %u\n", priv->serial_number[0],
+			   priv->serial_number[1], dev_name(&priv->hdev->dev),
+			   priv->firmware_version, priv->power_cycles);
+	mutex_unlock(&octo_devices_lock);
 
 	return 0;
 }
+DEFINE_SHOW_ATTRIBUTE(devices);
 
-#ifdef CONFIG_DEBUG_FS
+static void __init octo_debugfs_create(void)
+{
+	octo_debugfs_root = debugfs_create_dir(DRIVER_NAME, NULL);
+	octo_debugfs_by_serial = debugfs_create_dir("by-serial", octo_debugfs_root);
+	debugfs_create_file("devices", 0444, octo_debugfs_root, NULL, &devices_fops);
+}
 
-static int serial_number_show(struct seq_file *seqf, void *unused)
+static void octo_debugfs_destroy(void)
 {
-	struct octo_data *priv = seqf->private;
+	debugfs_remove_recursive(octo_debugfs_root);
+}
 
-	seq_printf(seqf, "%05u-%05u\n", priv->serial_number[0], priv->serial_number[1]);
+#else
 
-	return 0;
+static void octo_debugfs_init(struct octo_data *priv)
+{
 }
-DEFINE_SHOW_ATTRIBUTE(serial_number);
 
-static int firmware_version_show(struct seq_file *seqf, void *unused)
+static void octo_debugfs_link(struct octo_data *priv)
 {
-	struct octo_data *priv = seqf->private;
+}
 
-	seq_printf(seqf, "%u\n", priv->firmware_version);
+static void __init octo_debugfs_create(void)
+{
+}
 
-	return 0;
+static void octo_debugfs_destroy(void)
+{
 }
-DEFINE_SHOW_ATTRIBUTE(firmware_version);
 
-static int power_cycles_show(struct seq_file *seqf, void *unused)
+#endif
+
+static u32 octo_serial_key(const u32 *serial_number)
 {
-	struct octo_data *priv = seqf->private;
+	return serial_number[0] << 16 | serial_number[1];
+}
 
-	seq_printf(seqf, "%u\n", priv->power_cycles);
+static struct octo_data *octo_find_device(const u32 *serial_number)
+{
+	struct octo_data *priv;
 
-	return 0;
+	lockdep_assert_held(&octo_devices_lock);
+
+	hash_for_each_possible(octo_devices, priv, node, octo_serial_key(serial_number))
+		if (priv->serial_number[0] == serial_number[0] &&
+		    priv->serial_number[1] == serial_number[1])
+			return priv;
+
+	return NULL;
 }
-DEFINE_SHOW_ATTRIBUTE(power_cycles);
 
-static void octo_debugfs_init(struct octo_data *priv)
+static void octo_register_device(struct work_struct *work)
 {
-	char name[32];
+	struct octo_data *priv = container_of(work, struct octo_data, register_work);
 
-	scnprintf(name, sizeof(name), "%s-%s", DRIVER_NAME, dev_name(&priv->hdev->dev));
+	mutex_lock(&octo_devices_lock);
 
-	priv->debugfs = debugfs_create_dir(name, NULL);
-	debugfs_create_file("serial_number", 0444, priv->debugfs, priv, &serial_number_fops);
-	debugfs_create_file("firmware_version", 0444, priv->debugfs, priv, &firmware_version_fops);
-	debugfs_create_file("power_cycles", 0444, priv->debugfs, priv, &power_cycles_fops);
+	if (octo_find_device(priv->serial_number)) {
+		hid_warn(priv->hdev, "serial number %05u-%05u is already in use\n",
+			 priv->serial_number[0], priv->serial_number[1]);
+		goto unlock;
+	}
+
+	hash_add(octo_devices, &priv->node, octo_serial_key(priv->serial_number));
+	octo_debugfs_link(priv);
+	priv->registered = true;
+
+unlock:
+	mutex_unlock(&octo_devices_lock);
 }
 
-#else
+/* Called once no more reports can arrive to queue the registration again */
+static void octo_unregister_device(struct octo_data *priv)
+{
+	cancel_work_sync(&priv->register_work);
 
-static void octo_debugfs_init(struct octo_data *priv)
+	mutex_lock(&octo_devices_lock);
+
+	if (priv->registered) {
+		hash_del(&priv->node);
+		debugfs_remove(priv->by_serial);
+		priv->registered = false;
+	}
+
+	mutex_unlock(&octo_devices_lock);
+}
+
+/*
+ * Reports are checked against the size the decoder needs rather than the
+ * descriptor, which only serves to flag firmware with a shorter layout and
+ * to size the raw report ring.
+ */
+static unsigned int octo_status_report_len(struct hid_device *hdev, unsigned int min_size)
 {
+	struct hid_report *report;
+	unsigned int len;
+
+	report = hdev->report_enum[HID_INPUT_REPORT].report_id_hash[OCTO_STATUS_REPORT_ID];
+	if (!report)
+		return min_size;
+
+	len = hid_report_len(report);
+	if (len < min_size) {
+		hid_warn(hdev, "status report is %u bytes, need at least %u\n", len, min_size);
+		return min_size;
+	}
+
+	return len;
 }
 
-#endif
+/*
+ * The hwmon device is registered once the first report has been decoded, so
+ * that it never shows up without values, or once the report would be stale
+ * if the device doesn't report in time
+ */
+static void octo_hwmon_register(struct work_struct *work)
+{
+	struct octo_data *priv = container_of(to_delayed_work(work), struct octo_data,
+					      hwmon_work);
+	struct device *hwmon_dev;
+
+	if (priv->hwmon_dev)
+		return;
+
+	hwmon_dev = hwmon_device_register_with_info(&priv->hdev->dev, priv->product->name, priv,
+						    priv->product->chip_info, octo_groups);
+	if (IS_ERR(hwmon_dev)) {
+		hid_err(priv->hdev, "failed to register hwmon device: %ld\n", PTR_ERR(hwmon_dev));
+		return;
+	}
+
+	WRITE_ONCE(priv->hwmon_dev, hwmon_dev);
+}
+
+static void octo_hwmon_unregister(struct octo_data *priv)
+{
+	unsigned long flags;
+
+	write_seqlock_irqsave(&priv->lock, flags);
+	priv->removing = true;
+	write_sequnlock_irqrestore(&priv->lock, flags);
+
+	/*
+	 * A report decoded before may still be notifying alarms, or queue
+	 * hwmon_work after seeing removing unset, so it goes first
+	 */
+	cancel_work_sync(&priv->decode_work);
+	cancel_delayed_work_sync(&priv->hwmon_work);
+
+	if (priv->hwmon_dev)
+		hwmon_device_unregister(priv->hwmon_dev);
+}
+
+/* After wake_up_pollfree(), priv->wait must outlive an RCU grace period */
+static void octo_free(void *data)
+{
+	struct octo_data *priv = data;
+
+	kfree_rcu(priv, rcu);
+}
 
 static int octo_probe(struct hid_device *hdev, const struct hid_device_id *id)
 {
 	struct octo_data *priv;
 	int ret;
 
-	priv = devm_kzalloc(&hdev->dev, sizeof(*priv), GFP_KERNEL);
+	priv = kzalloc(sizeof(*priv), GFP_KERNEL);
 	if (!priv)
 		return -ENOMEM;
 
+	ret = devm_add_action_or_reset(&hdev->dev, octo_free, priv);
+	if (ret)
+		return ret;
+
 	priv->hdev = hdev;
+	priv->product = &octo_products[id->driver_data];
+	priv->probed_ns = ktime_get_ns();
 	hid_set_drvdata(hdev, priv);
 
-	priv->updated = jiffies - OCTO_STATUS_UPDATE_INTERVAL;
+	seqlock_init(&priv->lock);
+	init_waitqueue_head(&priv->wait);
+	priv->avg_samples = OCTO_AVERAGE_SAMPLES;
+	priv->update_interval = OCTO_UPDATE_INTERVAL;
+	octo_limits_init(priv);
+	mutex_init(&priv->ctrl.lock);
+	INIT_DELAYED_WORK(&priv->ctrl.flush_work, octo_ctrl_flush);
+	mutex_init(&priv->stream_lock);
+	INIT_DELAYED_WORK(&priv->idle_work, octo_idle_work);
+	INIT_DELAYED_WORK(&priv->hwmon_work, octo_hwmon_register);
+	INIT_WORK(&priv->register_work, octo_register_device);
+	spin_lock_init(&priv->pending_lock);
+	INIT_WORK(&priv->decode_work, octo_decode_work);
+	mutex_init(&priv->replay_lock);
+	priv->replay_loops = 1000;
+
+	/* Without fans there are no pwm channels and no control report is ever sent */
+	if (priv->product->num_fans) {
+		priv->ctrl.buf = devm_kzalloc(&hdev->dev, priv->product->ctrl_report_size,
+					      GFP_KERNEL);
+		priv->ctrl.secondary = devm_kzalloc(&hdev->dev, sizeof(octo_secondary_report),
+						    GFP_KERNEL);
+		if (!priv->ctrl.buf || !priv->ctrl.secondary)
+			return -ENOMEM;
+	}
+	priv->sample.updated = jiffies;
+
+	ret = octo_ring_init(&hdev->dev, &priv->history, history_length,
+			     sizeof(priv->sample.sensors));
+	if (ret)
+		return ret;
 
 	ret = hid_parse(hdev);
 	if (ret)
 		return ret;
 
+	priv->status_report_size = priv->product->status_report_min_size;
+	priv->status_report_len = octo_status_report_len(hdev, priv->status_report_size);
+
+	ret = octo_ring_init(&hdev->dev, &priv->reports, raw_history_length,
+			     priv->status_report_len);
+	if (ret)
+		return ret;
+
+	priv->pending = devm_kzalloc(&hdev->dev, priv->status_report_len, GFP_KERNEL);
+	priv->decode_buf = devm_kzalloc(&hdev->dev, priv->status_report_len, GFP_KERNEL);
+	if (!priv->pending || !priv->decode_buf)
+		return -ENOMEM;
+
+	/* Torn down by devres after hid_hw_stop(), so that nothing pushes to it anymore */
+	ret = octo_iio_init(priv);
+	if (ret)
+		return ret;
+
 	ret = hid_hw_start(hdev, HID_CONNECT_HIDRAW);
 	if (ret)
 		return ret;
@@ -429,22 +3006,24 @@ static int octo_probe(struct hid_device *hdev, const struct hid_device_id *id)
 	if (ret)
 		goto fail_and_stop;
 
-	priv->hwmon_dev = hwmon_device_register_with_info(&hdev->dev, "octo", priv,
-							  &octo_chip_info, NULL);
-
-	if (IS_ERR(priv->hwmon_dev)) {
-		ret = PTR_ERR(priv->hwmon_dev);
-		goto fail_and_close;
+	priv->stream_open = true;
+	if (idle_close) {
+		priv->read_stats.last_read = jiffies;
+		schedule_delayed_work(&priv->idle_work, msecs_to_jiffies(idle_close));
 	}
 
+	schedule_delayed_work(&priv->hwmon_work, msecs_to_jiffies(octo_stale_timeout(priv)));
+
 	octo_debugfs_init(priv);
 
 	return 0;
 
-fail_and_close:
-	hid_hw_close(hdev);
 fail_and_stop:
+	/* hidraw may have been opened and delivered reports in the meantime */
+	octo_hwmon_unregister(priv);
 	hid_hw_stop(hdev);
+	cancel_work_sync(&priv->decode_work);
+	octo_unregister_device(priv);
 	return ret;
 }
 
@@ -453,14 +3032,77 @@ static void octo_remove(struct hid_device *hdev)
 	struct octo_data *priv = hid_get_drvdata(hdev);
 
 	debugfs_remove_recursive(priv->debugfs);
-	hwmon_device_unregister(priv->hwmon_dev);
-
-	hid_hw_close(hdev);
+	/*
+	 * poll() and epoll keep waiting on priv->wait after the debugfs files
+	 * are gone, detach them. octo_free() then waits a grace period for
+	 * epoll to let go of it.
+	 */
+	wake_up_pollfree(&priv->wait);
+	octo_hwmon_unregister(priv);
+
+	/* Pending fan changes are dropped, the device may already be gone */
+	cancel_delayed_work_sync(&priv->ctrl.flush_work);
+
+	/* Readers are gone, so the stream can't be reopened anymore */
+	cancel_delayed_work_sync(&priv->idle_work);
+	if (priv->stream_open)
+		hid_hw_close(hdev);
 	hid_hw_stop(hdev);
+
+	/* No reports arrive anymore, the last one may still queue register_work */
+	cancel_work_sync(&priv->decode_work);
+	octo_unregister_device(priv);
+}
+
+#ifdef CONFIG_PM
+
+static int octo_suspend(struct hid_device *hdev, pm_message_t message)
+{
+	struct octo_data *priv = hid_get_drvdata(hdev);
+
+	/* Send pending fan changes while the device is still there */
+	flush_delayed_work(&priv->ctrl.flush_work);
+	cancel_delayed_work_sync(&priv->idle_work);
+
+	return 0;
+}
+
+static int octo_resume(struct hid_device *hdev)
+{
+	struct octo_data *priv = hid_get_drvdata(hdev);
+
+	/*
+	 * An open stream is restarted by the transport, a closed one is
+	 * reopened by the next read. Give readers a full idle interval
+	 * from now before closing it.
+	 */
+	if (idle_close && READ_ONCE(priv->stream_open)) {
+		WRITE_ONCE(priv->read_stats.last_read, jiffies);
+		schedule_delayed_work(&priv->idle_work, msecs_to_jiffies(idle_close));
+	}
+
+	return 0;
+}
+
+static int octo_reset_resume(struct hid_device *hdev)
+{
+	struct octo_data *priv = hid_get_drvdata(hdev);
+
+	/* The device may have lost or changed its settings while being reset */
+	mutex_lock(&priv->ctrl.lock);
+	octo_ctrl_invalidate(&priv->ctrl);
+	mutex_unlock(&priv->ctrl.lock);
+
+	return octo_resume(hdev);
 }
 
+#endif
+
 static const struct hid_device_id octo_table[] = {
-	{ HID_USB_DEVICE(0x0c70, 0xf011) }, /* Aquacomputer Octo */
+	{ HID_USB_DEVICE(0x0c70, 0xf00d), .driver_data = OCTO_PRODUCT_QUADRO },
+	{ HID_USB_DEVICE(0x0c70, 0xf00e), .driver_data = OCTO_PRODUCT_D5NEXT },
+	{ HID_USB_DEVICE(0x0c70, 0xf010), .driver_data = OCTO_PRODUCT_FARBWERK360 },
+	{ HID_USB_DEVICE(0x0c70, 0xf011), .driver_data = OCTO_PRODUCT_OCTO },
 	{},
 };
 
@@ -472,23 +3114,50 @@ static struct hid_driver octo_driver = {
 	.probe = octo_probe,
 	.remove = octo_remove,
 	.raw_event = octo_raw_event,
+#ifdef CONFIG_PM
+	.suspend = octo_suspend,
+	.resume = octo_resume,
+	.reset_resume = octo_reset_resume,
+#endif
+	.driver = {
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
+	},
 };
 
 static int __init octo_init(void)
 {
-	return hid_register_driver(&octo_driver);
+	int ret;
+
+	/* High priority, so that samples don't wait behind other work for long */
+	octo_wq = alloc_workqueue(DRIVER_NAME, WQ_HIGHPRI, 0);
+	if (!octo_wq)
+		return -ENOMEM;
+
+	octo_debugfs_create();
+
+	ret = hid_register_driver(&octo_driver);
+	if (ret) {
+		octo_debugfs_destroy();
+		destroy_workqueue(octo_wq);
+	}
+
+	return ret;
 }
 
 static void __exit octo_exit(void)
 {
 	hid_unregister_driver(&octo_driver);
+	octo_debugfs_destroy();
+	destroy_workqueue(octo_wq);
 }
 
-/* Request to initialize after the HID bus to ensure it's not being loaded before */
-
-late_initcall(octo_init);
+module_init(octo_init);
 module_exit(octo_exit);
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("William Mandra <wmandra@gmail.com>");
-MODULE_DESCRIPTION("Hwmon driver for Aquacomputer Octo");
+MODULE_DESCRIPTION("Hwmon driver for Aquacomputer Octo, Quadro, D5 Next and Farbwerk 360");
+
+#ifdef CONFIG_AQUACOMPUTER_OCTO_KUNIT_TEST
+#include "aquacomputer-octo-test.c"
+#endif